@@ -0,0 +1,149 @@
+// History block codec
+// Each flush becomes one block that decodes on its own: timestamps as delta-of-delta,
+// temperatures as deltas of the packed centi-degree values (see PackedLogRecord), with
+// the common small deltas packed two per byte. A tag byte per entry says which fields
+// need the wider forms.
+//
+// Plain C++ with no Arduino dependencies, so the native test env can build it on the host.
+
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#define HIST_TAG_TIME 0x01        // Delta-of-delta timestamp follows (zigzag varint)
+#define HIST_TAG_FAULTS 0x02      // New fault bits follow
+#define HIST_TAG_TEMP_WIDE 0x04   // Temperature deltas as two zigzag varints, else one nibble pair
+#define HIST_TAG_RAW_WIDE 0x08    // Raw residual deltas as two zigzag varints, else one nibble pair
+#define HIST_MAX_ENCODED_ENTRY 17 // Worst case: tag, 5-byte time, faults, 3+3 temp and 2+2 raw varint bytes
+
+// One entry in the quantized form the codec works on
+struct HistorySample {
+  uint32_t timestamp;
+  uint8_t faults;
+  int16_t leftTemp;
+  int16_t rightTemp;
+  int8_t leftRawDelta;
+  int8_t rightRawDelta;
+};
+
+inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+inline void putVarint(uint8_t* out, size_t& pos, uint32_t v) {
+  while (v >= 0x80) {
+    out[pos++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  out[pos++] = v;
+}
+
+inline bool getVarint(const uint8_t* in, size_t len, size_t& pos, uint32_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return false;
+    uint8_t b = in[pos++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+inline bool fitsNibble(int32_t v) {
+  return v >= -8 && v <= 7;
+}
+
+// Encode samples into out (at least count * HIST_MAX_ENCODED_ENTRY bytes); returns the size
+inline size_t encodeHistoryBlock(const HistorySample* samples, int count, uint8_t* out) {
+  size_t pos = 0;
+  HistorySample prev = {count ? samples[0].timestamp : 0, 0, 0, 0, 0, 0};
+  int32_t prevDelta = 0;
+
+  for (int i = 0; i < count; i++) {
+    const HistorySample& s = samples[i];
+    int32_t delta = (int32_t)(s.timestamp - prev.timestamp);
+    int32_t dod = delta - prevDelta;
+    int32_t dl = s.leftTemp - prev.leftTemp, dr = s.rightTemp - prev.rightTemp;
+    int32_t drl = s.leftRawDelta - prev.leftRawDelta, drr = s.rightRawDelta - prev.rightRawDelta;
+
+    uint8_t tag = 0;
+    if (dod != 0) tag |= HIST_TAG_TIME;
+    if (s.faults != prev.faults) tag |= HIST_TAG_FAULTS;
+    if (!fitsNibble(dl) || !fitsNibble(dr)) tag |= HIST_TAG_TEMP_WIDE;
+    if (!fitsNibble(drl) || !fitsNibble(drr)) tag |= HIST_TAG_RAW_WIDE;
+
+    out[pos++] = tag;
+    if (tag & HIST_TAG_TIME) putVarint(out, pos, zigzag(dod));
+    if (tag & HIST_TAG_FAULTS) out[pos++] = s.faults;
+    if (tag & HIST_TAG_TEMP_WIDE) {
+      putVarint(out, pos, zigzag(dl));
+      putVarint(out, pos, zigzag(dr));
+    } else {
+      out[pos++] = ((dl & 0x0F) << 4) | (dr & 0x0F);
+    }
+    if (tag & HIST_TAG_RAW_WIDE) {
+      putVarint(out, pos, zigzag(drl));
+      putVarint(out, pos, zigzag(drr));
+    } else {
+      out[pos++] = ((drl & 0x0F) << 4) | (drr & 0x0F);
+    }
+
+    prev = s;
+    prevDelta = delta;
+  }
+  return pos;
+}
+
+// Decode a block; fn returns false to stop. Returns false on stop or malformed input.
+inline bool decodeHistoryBlock(const uint8_t* in, size_t len, uint32_t firstTimestamp, int count,
+                               std::function<bool(const HistorySample&)> fn) {
+  size_t pos = 0;
+  HistorySample s = {firstTimestamp, 0, 0, 0, 0, 0};
+  int32_t delta = 0;
+  uint32_t v1, v2;
+
+  for (int i = 0; i < count; i++) {
+    if (pos >= len) return false;
+    uint8_t tag = in[pos++];
+    if (tag & HIST_TAG_TIME) {
+      if (!getVarint(in, len, pos, v1)) return false;
+      delta += unzigzag(v1);
+    }
+    s.timestamp += delta;
+    if (tag & HIST_TAG_FAULTS) {
+      if (pos >= len) return false;
+      s.faults = in[pos++];
+    }
+    if (tag & HIST_TAG_TEMP_WIDE) {
+      if (!getVarint(in, len, pos, v1) || !getVarint(in, len, pos, v2)) return false;
+      s.leftTemp += unzigzag(v1);
+      s.rightTemp += unzigzag(v2);
+    } else {
+      if (pos >= len) return false;
+      s.leftTemp += (int8_t)in[pos] >> 4;
+      s.rightTemp += (int8_t)(in[pos] << 4) >> 4;
+      pos++;
+    }
+    if (tag & HIST_TAG_RAW_WIDE) {
+      if (!getVarint(in, len, pos, v1) || !getVarint(in, len, pos, v2)) return false;
+      s.leftRawDelta += unzigzag(v1);
+      s.rightRawDelta += unzigzag(v2);
+    } else {
+      if (pos >= len) return false;
+      s.leftRawDelta += (int8_t)in[pos] >> 4;
+      s.rightRawDelta += (int8_t)(in[pos] << 4) >> 4;
+      pos++;
+    }
+    if (!fn(s)) return false;
+  }
+  return pos == len;
+}
+
+#endif // HISTORY_CODEC_H
@@ -0,0 +1,131 @@
+// On-flash layout of the persistent temperature history
+// A segment file is a HistorySegmentHeader followed by blocks, each a HistoryBlockHeader
+// plus the encoded entries (see history_codec.h). The index file is a plain array of
+// HistoryIndexEntry, oldest segment first.
+//
+// The helpers are templates over the file and filesystem types so the firmware can use
+// them with LittleFS and the native tests with a file-backed mock. They only need
+// File::read/write/position/size/seek(pos) and FS::exists/open/rename.
+
+#ifndef HISTORY_FORMAT_H
+#define HISTORY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "history_codec.h"
+
+#define HIST_INDEX_PATH "/hist/index.bin"
+#define HIST_INDEX_TMP_PATH "/hist/index.tmp"
+#define HIST_MAGIC 0x53484346          // "FCHS"
+#define HIST_FORMAT_VERSION 2            // 2: compressed blocks
+#define HIST_STAGE_ENTRIES 30          // Entries per block at most; one flash write per minute at 2 s logging
+#define HIST_BLOCK_MAGIC 0xB10C
+#define HIST_BLOCK_MAX_BYTES (HIST_STAGE_ENTRIES * HIST_MAX_ENCODED_ENTRY)
+
+struct HistorySegmentHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t blockHeaderSize;
+  uint32_t segmentId;
+  uint32_t createdAt;
+};
+
+// Precedes each compressed block; one block per flush
+struct HistoryBlockHeader {
+  uint16_t magic;
+  uint16_t length;                     // Encoded bytes following the header
+  uint16_t count;                      // Entries in the block
+  uint16_t reserved;
+  uint32_t firstTimestamp;
+  uint32_t lastTimestamp;
+};
+
+// One per segment, oldest first - lets a time lookup pick the right file without opening any
+struct HistoryIndexEntry {
+  uint32_t segmentId;
+  uint32_t firstTimestamp;
+  uint32_t lastTimestamp;
+  uint32_t count;
+};
+
+template <typename FileT>
+bool writeSegmentHeader(FileT& file, uint32_t segmentId, uint32_t createdAt) {
+  HistorySegmentHeader header = {HIST_MAGIC, HIST_FORMAT_VERSION, sizeof(HistoryBlockHeader), segmentId, createdAt};
+  return file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+}
+
+template <typename FileT>
+bool readSegmentHeader(FileT& file, HistorySegmentHeader& header) {
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) return false;
+  return header.magic == HIST_MAGIC && header.version == HIST_FORMAT_VERSION &&
+         header.blockHeaderSize == sizeof(HistoryBlockHeader);
+}
+
+// Encode count (1..HIST_STAGE_ENTRIES) samples through buffer (HIST_BLOCK_MAX_BYTES) and
+// append them as one block. block is filled in even when the write fails; a failed write
+// may leave a torn block behind, so nothing more can be appended to the file.
+template <typename FileT>
+bool appendHistoryBlock(FileT& file, const HistorySample* samples, int count, uint8_t* buffer,
+                        HistoryBlockHeader& block) {
+  block.magic = HIST_BLOCK_MAGIC;
+  block.count = count;
+  block.length = encodeHistoryBlock(samples, count, buffer);
+  block.reserved = 0;
+  block.firstTimestamp = samples[0].timestamp;
+  block.lastTimestamp = samples[count - 1].timestamp;
+  return file.write((const uint8_t*)&block, sizeof(block)) == sizeof(block) &&
+         file.write(buffer, block.length) == block.length;
+}
+
+// Read the block header at the file's current position. A block cut short by a power
+// cut fails here, which ends the segment.
+template <typename FileT>
+bool readBlockHeader(FileT& file, HistoryBlockHeader& block) {
+  size_t offset = file.position();
+  if (file.read((uint8_t*)&block, sizeof(block)) != sizeof(block)) return false;
+  return block.magic == HIST_BLOCK_MAGIC && block.count > 0 && block.length <= HIST_BLOCK_MAX_BYTES &&
+         offset + sizeof(block) + block.length <= file.size();
+}
+
+// Recover a segment's count and time range from its block headers, starting just after
+// the segment header. Returns false if the segment ends in a torn block; entry then
+// covers the blocks before it.
+template <typename FileT>
+bool scanHistorySegment(FileT& file, HistoryIndexEntry& entry) {
+  entry.count = 0;
+  HistoryBlockHeader block;
+  while (file.position() < file.size()) {
+    if (!readBlockHeader(file, block)) return false;
+    if (entry.count == 0) entry.firstTimestamp = block.firstTimestamp;
+    entry.lastTimestamp = block.lastTimestamp;
+    entry.count += block.count;
+    file.seek(file.position() + block.length);
+  }
+  return true;
+}
+
+// Write the index to a temp file and rename it, so a power cut leaves either the old or new index
+template <typename FS>
+bool writeHistoryIndex(FS& fs, const HistoryIndexEntry* segments, int count) {
+  auto file = fs.open(HIST_INDEX_TMP_PATH, "w");
+  if (!file) return false;
+  size_t bytes = sizeof(HistoryIndexEntry) * count;
+  bool ok = file.write((const uint8_t*)segments, bytes) == bytes;
+  file.close();
+  return ok && fs.rename(HIST_INDEX_TMP_PATH, HIST_INDEX_PATH);
+}
+
+// Returns the number of entries read; a trailing partial entry is ignored
+template <typename FS>
+int readHistoryIndex(FS& fs, HistoryIndexEntry* segments, int maxSegments) {
+  if (!fs.exists(HIST_INDEX_PATH)) return 0;
+  auto file = fs.open(HIST_INDEX_PATH, "r");
+  if (!file) return 0;
+  size_t entries = file.size() / sizeof(HistoryIndexEntry);
+  if (entries > (size_t)maxSegments) entries = maxSegments;
+  int count = file.read((uint8_t*)segments, entries * sizeof(HistoryIndexEntry)) / sizeof(HistoryIndexEntry);
+  file.close();
+  return count;
+}
+
+#endif // HISTORY_FORMAT_H
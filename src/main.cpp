@@ -3,13 +3,21 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
+#include <Preferences.h>
 #include <math.h>
 #include <ESPmDNS.h>
 #include <DNSServer.h>
 #include <ArduinoOTA.h>
 #include <HTTPClient.h>
 #include <Update.h>
+#include <mbedtls/sha256.h>
+#include <esp_ota_ops.h>
+#include <esp32/rom/miniz.h>
+#include <functional>
 #include <time.h>
+#include <atomic>
+#include <stdarg.h>
+#include <esp_heap_caps.h>
 
 // Embedded HTML files (stored in flash memory)
 #include "html_index.h"
@@ -17,6 +25,7 @@
 #include "html_manual.h"
 #include "html_charts.h"
 #include "html_settings.h"
+#include "history_format.h"
 
 // GitHub OTA Configuration
 #define GITHUB_OWNER "jack-cbr2000"
@@ -29,10 +38,219 @@
 #define GMT_OFFSET_SEC 0  // UTC
 #define DAYLIGHT_OFFSET_SEC 3600  // +1 hour for DST if needed
 
+// Logging configuration
+#define LOG_RING_SLOTS 32          // Must be a power of two
+#define LOG_LINE_MAX 128           // Longer messages are truncated
+#define LOG_RATE_PER_SEC 8         // Sustained lines per second per module (errors are exempt)
+#define LOG_RATE_BURST 16          // Lines a module may emit back-to-back
+#define LOG_DRAIN_INTERVAL_MS 20
+
+enum LogLevel {
+  LOG_LEVEL_NONE = 0,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG
+};
+
+enum LogModule {
+  LOG_SYS = 0,
+  LOG_SENSOR,
+  LOG_CTRL,
+  LOG_WEB,
+  LOG_OTA,
+  LOG_CFG,
+  LOG_NET,
+  LOG_MODULE_COUNT
+};
+
+// Log lines are formatted by the caller into a lock-free ring and written to the UART by a
+// low-priority task, so the control path never waits on the 115200 baud serial port
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  uint32_t timestamp;
+  uint8_t level;
+  uint8_t module;
+  char text[LOG_LINE_MAX];
+};
+
+LogSlot logRing[LOG_RING_SLOTS];
+std::atomic<uint32_t> logEnqueuePos(0);
+uint32_t logDequeuePos = 0;                      // Only touched by the drain task
+std::atomic<uint32_t> logDropped(0);             // Ring full
+std::atomic<uint32_t> logSuppressed(0);          // Rate limited
+uint8_t logLevels[LOG_MODULE_COUNT];
+float logTokens[LOG_MODULE_COUNT];
+unsigned long logTokenRefill[LOG_MODULE_COUNT];
+
+const char* const LOG_MODULE_NAMES[LOG_MODULE_COUNT] = {"sys", "sensor", "ctrl", "web", "ota", "cfg", "net"};
+const char* const LOG_LEVEL_NAMES[] = {"none", "error", "warn", "info", "debug"};
+const char LOG_LEVEL_TAGS[] = {'-', 'E', 'W', 'I', 'D'};
+
+void logPrintf(LogLevel level, LogModule module, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+#define LOGE(module, ...) logPrintf(LOG_LEVEL_ERROR, module, __VA_ARGS__)
+#define LOGW(module, ...) logPrintf(LOG_LEVEL_WARN, module, __VA_ARGS__)
+#define LOGI(module, ...) logPrintf(LOG_LEVEL_INFO, module, __VA_ARGS__)
+#define LOGD(module, ...) logPrintf(LOG_LEVEL_DEBUG, module, __VA_ARGS__)
+
+inline bool logEnabled(LogLevel level, LogModule module) {
+  return level <= logLevels[module];
+}
+
+// Token bucket per module. Updates from different tasks may race; the limit is approximate by design.
+bool logRateAllow(LogModule module) {
+  unsigned long now = millis();
+  float refill = (now - logTokenRefill[module]) * (LOG_RATE_PER_SEC / 1000.0f);
+  logTokenRefill[module] = now;
+  logTokens[module] = min(logTokens[module] + refill, (float)LOG_RATE_BURST);
+  if (logTokens[module] < 1.0f) return false;
+  logTokens[module] -= 1.0f;
+  return true;
+}
+
+void logPrintf(LogLevel level, LogModule module, const char* format, ...) {
+  if (!logEnabled(level, module)) return;
+  if (level > LOG_LEVEL_ERROR && !logRateAllow(module)) {
+    logSuppressed.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Claim a slot (bounded MPMC queue - each slot's sequence says whose turn it is)
+  uint32_t pos = logEnqueuePos.load(std::memory_order_relaxed);
+  LogSlot* slot;
+  for (;;) {
+    slot = &logRing[pos & (LOG_RING_SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (logEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      logDropped.fetch_add(1, std::memory_order_relaxed);  // Ring full - never block the caller
+      return;
+    } else {
+      pos = logEnqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->timestamp = millis();
+  slot->level = level;
+  slot->module = module;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(slot->text, sizeof(slot->text), format, args);
+  va_end(args);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void logDrainTask(void* param) {
+  uint32_t reportedDropped = 0;
+  uint32_t reportedSuppressed = 0;
+  char prefix[32];
+
+  for (;;) {
+    for (;;) {
+      LogSlot* slot = &logRing[logDequeuePos & (LOG_RING_SLOTS - 1)];
+      if (slot->sequence.load(std::memory_order_acquire) != logDequeuePos + 1) break;
+
+      int len = snprintf(prefix, sizeof(prefix), "[%lu.%03lu] %c %s: ",
+        (unsigned long)(slot->timestamp / 1000), (unsigned long)(slot->timestamp % 1000),
+        LOG_LEVEL_TAGS[slot->level], LOG_MODULE_NAMES[slot->module]);
+      Serial.write((const uint8_t*)prefix, len);
+      Serial.write((const uint8_t*)slot->text, strnlen(slot->text, sizeof(slot->text)));
+      Serial.write('\n');
+
+      slot->sequence.store(logDequeuePos + LOG_RING_SLOTS, std::memory_order_release);
+      logDequeuePos++;
+    }
+
+    uint32_t dropped = logDropped.load(std::memory_order_relaxed);
+    uint32_t suppressed = logSuppressed.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped || suppressed != reportedSuppressed) {
+      Serial.printf("[log] %u lines dropped (ring full), %u rate limited\n",
+        (unsigned)(dropped - reportedDropped), (unsigned)(suppressed - reportedSuppressed));
+      reportedDropped = dropped;
+      reportedSuppressed = suppressed;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+void initLogging() {
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++) {
+    logRing[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+    logLevels[i] = LOG_LEVEL_INFO;
+    logTokens[i] = LOG_RATE_BURST;
+    logTokenRefill[i] = millis();
+  }
+
+  // Lowest useful priority, on the protocol core so it never preempts loop()
+  xTaskCreatePinnedToCore(logDrainTask, "logDrain", 3072, nullptr, 1, nullptr, 0);
+}
+
+int parseLogLevel(const String& name) {
+  for (int i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+    if (name == LOG_LEVEL_NAMES[i]) return i;
+  }
+  return -1;
+}
+
+String getLogConfigJSON() {
+  DynamicJsonDocument doc(512);
+  JsonObject modules = doc.createNestedObject("modules");
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+    modules[LOG_MODULE_NAMES[i]] = LOG_LEVEL_NAMES[logLevels[i]];
+  }
+  doc["dropped"] = logDropped.load(std::memory_order_relaxed);
+  doc["rateLimited"] = logSuppressed.load(std::memory_order_relaxed);
+  doc["ratePerSecond"] = LOG_RATE_PER_SEC;
+
+  String output;
+  serializeJson(doc, output);
+  return output;
+}
+
 // GitHub OTA variables
 unsigned long lastUpdateCheck = 0;
 bool otaUpdateInProgress = false;
 
+#define OTA_CHUNK_SIZE 1460            // One TCP segment per read
+#define OTA_STALL_TIMEOUT_MS 20000     // Treat the connection as dropped after this long without data
+#define OTA_MAX_RESUMES 8              // Range requests after a dropped connection
+#define OTA_RETRY_BASE_MS 2000UL       // Backoff doubles per attempt...
+#define OTA_RETRY_MAX_MS 60000UL       // ...up to this
+uint8_t otaChunk[OTA_CHUNK_SIZE];
+
+enum OtaFetchResult : uint8_t {
+  OTA_FETCH_DONE,
+  OTA_FETCH_RETRY,       // Connection dropped or stalled; resume from otaProgress.written
+  OTA_FETCH_FAILED,      // Not worth retrying (bad response, flash error)
+};
+
+// Progress of the current (or last) firmware download
+struct OtaProgress {
+  size_t total = 0;              // Image size, known after the first response
+  size_t written = 0;            // Bytes received and processed - the resume offset
+  size_t imageBytes = 0;         // Bytes handed to Update (larger than written for .gz images)
+  uint32_t resumes = 0;
+  unsigned long startedAt = 0;
+};
+OtaProgress otaProgress;
+
+// Post-update self-test of a pending-verify image
+#define OTA_VALIDATE_MIN_MS 60000        // Run for at least a minute before declaring the image good
+#define OTA_VALIDATE_TIMEOUT_MS 300000   // Roll back if the self-test has not passed by then
+#define OTA_VALIDATE_CONTROL_TICKS 10
+
+struct OtaValidation {
+  bool pending = false;          // Running image is pending verification
+  bool webServerUp = false;
+  uint32_t controlTicks = 0;
+};
+OtaValidation otaValidation;
+
 // Structure to hold GitHub release info
 struct GitHubRelease {
   String version;
@@ -42,15 +260,30 @@ struct GitHubRelease {
   time_t publishedAt;
 };
 
+// Last parsed release and its validators. Polls send them back, and GitHub answers 304 with
+// no body (not counted against the rate limit) until a new release is published.
+struct ReleaseCache {
+  bool valid = false;
+  GitHubRelease release;
+  String etag;
+  String lastModified;
+  uint32_t notModified = 0;    // Polls answered with 304
+};
+ReleaseCache releaseCache;
+
 // GitHub OTA forward declarations
 GitHubRelease checkForUpdates();
 bool downloadAndInstallFirmware(String firmwareUrl);
-bool verifyFirmwareIntegrity();
+bool verifyFirmwareIntegrity(const uint8_t actual[32], const uint8_t expected[32]);
 bool rollbackFirmware();
 void initiateManualUpdate();
+void initOtaValidation();
+void serviceOtaValidation();
 
 // Temperature logging configuration
-#define MAX_LOG_ENTRIES 500  // About 16 minutes at 2-second intervals
+#define MAX_LOG_ENTRIES 1600 // DRAM fallback: about 53 minutes at 2-second intervals (16 KB packed)
+#define PSRAM_LOG_SECONDS 86400        // With PSRAM, size the log for a day at the configured interval
+#define PSRAM_LOG_SHARE 4              // ...but never take more than 1/4 of free PSRAM
 
 // Temperature log entry structure
 struct TemperatureLogEntry {
@@ -59,12 +292,249 @@ struct TemperatureLogEntry {
   float rightTemp;
   float setpointLeft;
   float setpointRight;
+  float leftRaw;            // Unfiltered readings (leftTemp/rightTemp are filtered)
+  float rightRaw;
+  uint8_t faults;           // SENSOR_FAULT_LEFT / SENSOR_FAULT_RIGHT / LOG_FLAG_UNSYNCED bits
+};
+
+// In RAM the log is kept packed; TemperatureLogEntry is what readers get back.
+// Setpoints change rarely, so they are stored as change events instead of per entry.
+#define LOG_NO_VALUE INT16_MIN         // Temperature missing (sensor fault)
+#define LOG_RAW_NO_VALUE INT8_MIN      // Raw reading missing
+#define LOG_RAW_ONLY INT8_MAX          // Filtered value missing; the temperature field holds the raw reading
+#define LOG_RAW_STEP 0.05f             // Raw residual resolution (degrees), +/-6.3 degrees range
+#define LOG_REL_TIME_MAX 0xFFFFFFUL    // 24-bit offset from logTimeBase (~194 days)
+
+struct __attribute__((packed)) PackedLogRecord {
+  uint32_t timeFaults;      // Seconds since logTimeBase (low 24 bits), faults in the top byte
+  int16_t leftTemp;         // Filtered temperature, centi-degrees
+  int16_t rightTemp;
+  int8_t leftRawDelta;      // (raw - filtered) in LOG_RAW_STEP units
+  int8_t rightRawDelta;
 };
 
-// Global temperature log buffer
-TemperatureLogEntry tempLog[MAX_LOG_ENTRIES];
+// Global temperature log buffer, allocated by initTempLog()
+PackedLogRecord* tempLog = nullptr;
+int logCapacity = 0;
 int logHead = 0;  // Next write position (circular)
 int logCount = 0; // Number of valid entries
+bool logInPsram = false;
+
+// Cost of the log buffer on the control path, reported by /api/history/info
+struct LogBufferTiming {
+  uint32_t appends = 0;
+  uint32_t appendUsTotal = 0;
+  uint32_t appendUsMax = 0;
+  uint32_t tickUsMax = 0;        // Longest serviceSensorsAndControl() pass
+  // Boot benchmark, only with -DLOG_BUFFER_BENCHMARK (see benchmarkTempLog())
+  uint32_t fillUs = 0;           // Clear the whole buffer
+  uint32_t scanUs = 0;           // Read every record in order
+  uint32_t randomReadUs = 0;     // 1000 scattered record reads
+};
+
+LogBufferTiming logTiming;
+uint32_t logTimeBase = 0;  // Timestamp that record offsets are relative to
+
+#define SETPOINT_EVENT_CAPACITY 64
+#define SETPOINT_EVENTS_PATH "/hist/setpoints.bin"
+
+struct SetpointEvent {
+  uint32_t timestamp;       // First log entry using these setpoints
+  int16_t left;             // Centi-degrees
+  int16_t right;
+};
+
+struct SetpointEventLog {
+  SetpointEvent events[SETPOINT_EVENT_CAPACITY];
+  int head = 0;
+  int count = 0;
+  uint32_t persisted = 0;   // Events in the file, compacted once it reaches 4x capacity
+};
+
+SetpointEventLog setpointEvents;
+
+// Control event journal: compressor, zone, manual and sensor transitions as typed binary
+// records, so cycle behaviour can be reconstructed without high-rate temperature logs
+#define CONTROL_EVENT_CAPACITY 256
+#define CONTROL_EVENTS_PATH "/hist/events.bin"
+#define CONTROL_EVENT_PAGE_MAX 100
+#define EVENT_ZONE_NONE 0xFF
+
+enum ControlEventType : uint8_t {
+  EVT_BOOT = 1,
+  EVT_COMPRESSOR_START,       // zone = zone being cooled
+  EVT_COMPRESSOR_STOP,        // detail = StopReason
+  EVT_ZONE_SWITCH,            // zone = new zone
+  EVT_MAX_RUN_CUTOFF,         // Max run time reached (a stop follows once min run time allows)
+  EVT_MANUAL,                 // detail = ManualAction
+  EVT_SYSTEM,                 // detail = 1 enabled, 0 disabled
+  EVT_SENSOR_FAULT,           // zone = faulted sensor, detail = SensorFault
+  EVT_SENSOR_RECOVERED,
+  EVT_TIME_SYNC,              // NTP synced; earlier provisional timestamps were corrected
+  EVT_FIRMWARE,               // detail = FirmwareEvent
+};
+
+enum FirmwareEvent : uint8_t {
+  FIRMWARE_VALIDATED = 0,     // New image passed its self-test
+  FIRMWARE_ROLLED_BACK,       // New image failed it; rebooting into the previous one
+};
+
+enum StopReason : uint8_t {
+  STOP_OTHER = 0,
+  STOP_SATISFIED,
+  STOP_MAX_RUN,
+  STOP_DISABLED,
+};
+
+enum ManualAction : uint8_t {
+  MANUAL_COMPRESSOR_ON = 0,
+  MANUAL_COMPRESSOR_OFF,
+  MANUAL_SOLENOID_LEFT,
+  MANUAL_SOLENOID_RIGHT,
+  MANUAL_AUTO,
+};
+
+struct ControlEvent {
+  uint32_t seq;               // Increases by one per event, survives reboots (used for paging)
+  uint32_t timestamp;         // Same time base as the temperature log
+  uint8_t type;               // ControlEventType
+  uint8_t zone;               // 0 left, 1 right, EVENT_ZONE_NONE
+  uint8_t detail;
+  uint8_t flags;              // LOG_FLAG_UNSYNCED
+  int16_t leftTemp;           // Centi-degrees at the time of the event
+  int16_t rightTemp;
+};
+
+struct ControlEventLog {
+  ControlEvent events[CONTROL_EVENT_CAPACITY];
+  int head = 0;
+  int count = 0;
+  uint32_t nextSeq = 1;
+  uint32_t persisted = 0;     // Events in the file, compacted once it reaches 4x capacity
+  int pending = 0;            // Newest events not yet in the file; appended from loop()
+};
+
+ControlEventLog controlEvents;
+
+// Persistent history on LittleFS: append-only segment files plus a small index,
+// fed from a RAM staging buffer so flash is written in batches
+#define HIST_DIR "/hist"
+#define HIST_FLUSH_INTERVAL_MS 60000UL // Flush a partial stage after this long
+#define HIST_SEGMENT_RECORDS 7200      // Four hours per segment at 2 s logging (~25 KB compressed)
+#define HIST_MAX_SEGMENTS 24           // Bounds total size; the oldest segment is deleted
+#define HIST_READ_CHUNK 16             // Records per file read
+
+// Segment, block and index layouts are in history_format.h
+
+struct HistoryStore {
+  bool ready = false;
+  HistoryIndexEntry segments[HIST_MAX_SEGMENTS];
+  int segmentCount = 0;
+  uint32_t nextSegmentId = 0;
+  TemperatureLogEntry stage[HIST_STAGE_ENTRIES];
+  int stageCount = 0;
+  unsigned long lastFlush = 0;
+  uint32_t flushes = 0;
+  uint32_t writeErrors = 0;
+  bool tailTorn = false;               // Newest segment ends in a partial block; start a new one
+  uint32_t entriesWritten = 0;         // Since boot, for the compression ratio
+  uint32_t bytesWritten = 0;
+  int readers = 0;                     // historyForEach() calls in progress; segments don't rotate meanwhile
+};
+
+HistoryStore history;
+uint8_t historyBlockBuffer[HIST_BLOCK_MAX_BYTES];
+
+// Log time base. Until NTP syncs, entries get a provisional timestamp that continues from
+// the newest persisted one (so history stays ordered) and are flagged LOG_FLAG_UNSYNCED.
+// When NTP syncs, the offset to wall-clock time is applied to this boot's provisional
+// entries: rewritten in RAM, and recorded as a correction for blocks already on flash.
+#define TIME_VALID_AFTER 1609459200UL  // Jan 1, 2021 - time() before this means no NTP yet
+#define TIME_FIX_PATH "/hist/timefix.bin"
+#define TIME_FIX_CAPACITY 16
+
+struct TimeBase {
+  bool synced = false;
+  uint32_t bootStart = 0;              // Provisional time at boot: newest persisted timestamp
+  int32_t syncOffset = 0;              // Wall clock minus provisional time when NTP synced
+  uint32_t correctedEntries = 0;
+};
+
+// Provisional range [fromTs, toTs] of one boot, shifted by offset when read back from flash
+struct TimeCorrection {
+  uint32_t fromTs;
+  uint32_t toTs;
+  int32_t offset;
+};
+
+TimeBase timeBase;
+TimeCorrection timeCorrections[TIME_FIX_CAPACITY];
+int timeCorrectionCount = 0;
+
+// Round-robin tiers (RRD style): fixed-slot files on LittleFS, one slot per bucket,
+// rolled up incrementally from the raw log entries
+#define TIER_MAGIC 0x52524446          // "FDRR"
+#define TIER_FORMAT_VERSION 1
+#define TIER_NO_VALUE LOG_NO_VALUE     // Bucket had no valid samples for a zone
+#define RAW_TIER_SPAN_SEC 3600         // Ranges up to an hour are answered from raw entries
+#define MINUTE_TIER_SPAN_SEC 86400     // Ranges up to a day from 1-minute buckets
+#define EXPORT_SERVICE_EVERY 64        // Entries written between control loop passes during an export
+
+// Aggregated bucket as stored on flash (temperatures in centi-degrees)
+struct HistoryAggregate {
+  uint32_t timestamp;                  // Bucket start, 0 = empty slot
+  int16_t leftMin;
+  int16_t leftMax;
+  int16_t leftMean;
+  int16_t rightMin;
+  int16_t rightMax;
+  int16_t rightMean;
+  int16_t setpointLeft;
+  int16_t setpointRight;
+  uint16_t samples;
+  uint8_t faults;
+  uint8_t reserved;
+};
+
+struct TierHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t step;
+  uint32_t capacity;
+};
+
+// In-progress bucket
+struct AggregateBuilder {
+  uint32_t bucketStart = 0;
+  float leftSum = 0.0;
+  float rightSum = 0.0;
+  uint32_t leftCount = 0;
+  uint32_t rightCount = 0;
+  float leftMin = INFINITY;
+  float leftMax = -INFINITY;
+  float rightMin = INFINITY;
+  float rightMax = -INFINITY;
+  float setpointLeft = 0.0;
+  float setpointRight = 0.0;
+  uint32_t samples = 0;
+  uint8_t faults = 0;
+};
+
+struct HistoryTier {
+  const char* name;
+  const char* path;
+  uint32_t step;                       // Bucket length (seconds)
+  uint32_t capacity;                   // Slots in the file
+  bool ready;
+  AggregateBuilder current;
+};
+
+HistoryTier historyTiers[] = {
+  {"1m", HIST_DIR "/tier1m.rrd", 60, 1440, false, AggregateBuilder()},     // One day
+  {"15m", HIST_DIR "/tier15m.rrd", 900, 8640, false, AggregateBuilder()},  // 90 days
+};
+const int HISTORY_TIER_COUNT = sizeof(historyTiers) / sizeof(historyTiers[0]);
 
 // Testing mode - set to false for production
 #define TESTING_MODE false
@@ -77,6 +547,11 @@ int logCount = 0; // Number of valid entries
 #define SOLENOID_PIN 2
 #define LED_PIN 5
 
+// Temperature filter modes
+#define FILTER_NONE 0
+#define FILTER_EMA 1      // First-order low-pass with configurable time constant
+#define FILTER_KALMAN 2   // Scalar Kalman filter tracking temperature and rate of change
+
 // NTC thermistor constants (2.5k NTC)
 #define THERMISTOR_NOMINAL 2500
 #define TEMPERATURE_NOMINAL 25
@@ -120,12 +595,25 @@ struct Config {
   // Backward compatibility - single network fields (now deprecated)
   char old_ssid[32] = "";
   char old_password[32] = "";
+
+  // Temperature filtering between acquisition and control
+  uint8_t filterMode = FILTER_EMA;
+  float filterTimeConstant = 10.0;      // seconds (EMA)
+  float kalmanProcessNoise = 0.0001;    // Rate random walk, (°C/s)² per second
+  float kalmanMeasurementNoise = 0.05;  // Sensor noise variance (°C²)
+
+  // Independent rates for sampling, control evaluation and history logging
+  uint32_t sampleIntervalMs = 100;      // Sensor acquisition + filter
+  uint32_t controlIntervalMs = 1000;    // controlLogic() evaluation
+  uint32_t logIntervalMs = 2000;        // Decimated entries written to tempLog
 };
 
 // System state
 struct State {
-  float leftTemp = 0.0;
+  float leftTemp = 0.0;       // Filtered - used by the control logic
   float rightTemp = 0.0;
+  float leftTempRaw = 0.0;    // Last reading before filtering
+  float rightTempRaw = 0.0;
   bool compressorOn = false;
   bool solenoidOn = false;    // true = right zone, false = left zone
   bool leftCooling = false;
@@ -134,24 +622,184 @@ struct State {
   unsigned long lastCompressorStop = 0;
   unsigned long lastZoneSwitch = 0;
   unsigned long lastTempRead = 0;
+  unsigned long lastControlRun = 0;
+  unsigned long lastLogWrite = 0;
   int currentZone = 0;        // 0 = left, 1 = right
   bool systemEnabled = true;
+  bool maxRunCutoff = false;        // Max run time hit during the current compressor run
   bool manualMode = false;    // Track if manual control is active
   String status = "Idle";
 };
 
+// Stability-gated calibration capture
+#define CAL_CAPTURE_WINDOW 32            // Samples in the rolling window
+#define CAL_CAPTURE_SAMPLE_MS 100        // Sampling interval while capturing
+#define CAL_CAPTURE_VARIANCE_MAX 4.0     // Default stability threshold (ADC counts^2)
+#define CAL_CAPTURE_TIMEOUT_MS 600000UL  // Give up after 10 minutes without settling
+
+struct CalibrationCapture {
+  bool active = false;
+  int point = 0;                 // 1 or 2
+  float actualTemp = 0.0;
+  float varianceThreshold = CAL_CAPTURE_VARIANCE_MAX;
+  int leftWindow[CAL_CAPTURE_WINDOW];
+  int rightWindow[CAL_CAPTURE_WINDOW];
+  int windowIndex = 0;
+  int windowCount = 0;
+  long leftSum = 0;              // Running sums for O(1) rolling mean/variance
+  long rightSum = 0;
+  int64_t leftSumSq = 0;
+  int64_t rightSumSq = 0;
+  float leftVariance = 0.0;
+  float rightVariance = 0.0;
+  unsigned long totalSamples = 0;
+  unsigned long startedAt = 0;
+  unsigned long lastSample = 0;
+  float resistanceLeft = 0.0;
+  float resistanceRight = 0.0;
+  String result = "idle";        // idle, sampling, complete, timeout, cancelled, failed
+};
+
+CalibrationCapture calCapture;
+
+// Sensor health monitoring
+#define SENSOR_ADC_OPEN_MAX 8            // Divider pulled to GND: NTC open circuit
+#define SENSOR_ADC_SHORT_MIN 4087        // Divider pulled to 3.3V: NTC shorted
+#define SENSOR_TEMP_MIN -40.0            // Plausible range for a fridge compartment (°C)
+#define SENSOR_TEMP_MAX 80.0
+#define SENSOR_STUCK_MS 600000UL         // Bit-identical ADC value for 10 minutes
+#define SENSOR_MAX_RATE 1.0              // Max plausible change (°C per second)
+#define SENSOR_RATE_NOISE 2.0            // ADC noise allowance on top of the rate limit (°C)
+#define SENSOR_FAULT_DEBOUNCE 3          // Consecutive bad readings before a zone is faulted...
+#define SENSOR_FAULT_DEBOUNCE_MS 5000UL  // ...spanning at least this long
+#define SENSOR_RECOVER_COUNT 10          // Consecutive good readings before the fault clears...
+#define SENSOR_RECOVER_MS 20000UL        // ...spanning at least this long
+#define FAULT_DUTY_PERIOD_MIN 30.0       // Fallback cycle for a faulted zone (minutes)
+#define FAULT_DUTY_ON_MIN 10.0           // Cooling time within each fallback cycle (minutes)
+
+// Bits in TemperatureLogEntry::faults
+#define SENSOR_FAULT_LEFT 0x01
+#define SENSOR_FAULT_RIGHT 0x02
+#define LOG_FLAG_UNSYNCED 0x80           // Provisional timestamp (logged before NTP synced)
+
+enum SensorFault {
+  SENSOR_OK = 0,
+  SENSOR_OPEN,
+  SENSOR_SHORT,
+  SENSOR_OUT_OF_RANGE,
+  SENSOR_STUCK,
+  SENSOR_RATE
+};
+
+struct SensorHealth {
+  SensorFault lastReading = SENSOR_OK;   // Classification of the most recent sample
+  SensorFault fault = SENSOR_OK;         // Latched fault while faulted
+  bool faulted = false;
+  int badCount = 0;
+  int goodCount = 0;
+  unsigned long badSince = 0;
+  unsigned long goodSince = 0;
+  int lastAdc = -1;
+  unsigned long adcUnchangedSince = 0;
+  bool hasGood = false;
+  float lastGoodTemp = 0.0;
+  unsigned long lastGoodTime = 0;
+  unsigned long faultSince = 0;
+  unsigned long faultEvents = 0;
+};
+
+SensorHealth leftHealth;
+SensorHealth rightHealth;
+
+// Per-zone filter state
+struct ZoneFilter {
+  bool initialized = false;
+  float value = 0.0;          // Filtered temperature (°C)
+  float rate = 0.0;           // Estimated rate of change (°C/s, Kalman only)
+  float p00 = 0.0;            // Kalman error covariance
+  float p01 = 0.0;
+  float p11 = 0.0;
+  unsigned long lastUpdate = 0;
+};
+
+ZoneFilter leftFilter;
+ZoneFilter rightFilter;
+
+// Samples accumulated between log entries (decimation by averaging)
+struct LogAccumulator {
+  float leftSum = 0.0;
+  float rightSum = 0.0;
+  float leftRawSum = 0.0;
+  float rightRawSum = 0.0;
+  uint16_t leftCount = 0;     // Faulted samples (NAN) are left out of the mean
+  uint16_t rightCount = 0;
+  uint8_t faults = 0;         // Any fault seen during the interval
+};
+
+LogAccumulator logAccumulator;
+
+// Rolling per-zone statistics over fixed windows. Each window is a ring of STATS_BUCKETS
+// buckets; a sample updates one bucket and the running totals (O(1)), and the totals are
+// rebuilt from the buckets only when the oldest bucket expires. Queries just read the totals.
+#define STATS_BUCKETS 60
+#define STATS_WINDOW_COUNT 3
+#define STATS_MAX_SAMPLE_GAP_MS 5000UL  // Longer gaps (e.g. a blocking OTA) don't count as above-setpoint time
+
+const char* STATS_WINDOW_NAMES[STATS_WINDOW_COUNT] = {"1h", "24h", "7d"};
+const uint32_t STATS_WINDOW_SEC[STATS_WINDOW_COUNT] = {3600, 86400, 604800};
+
+struct StatsBucket {
+  uint32_t count;
+  float sum;                  // Relative to ZoneStats::reference, keeps the variance well conditioned
+  float sumSq;
+  float min;
+  float max;
+  uint32_t sampledMs;         // Time covered by samples
+  uint32_t aboveMs;           // ...of which above setpoint + hysteresis
+};
+
+struct RollingWindow {
+  StatsBucket buckets[STATS_BUCKETS];
+  int current = 0;
+  unsigned long bucketStart = 0;
+  // Totals over all buckets
+  uint32_t count = 0;
+  double sum = 0.0;
+  double sumSq = 0.0;
+  float min = NAN;
+  float max = NAN;
+  uint32_t sampledMs = 0;
+  uint32_t aboveMs = 0;
+};
+
+struct ZoneStats {
+  RollingWindow windows[STATS_WINDOW_COUNT];
+  bool started = false;
+  float reference = 0.0;
+  unsigned long lastSample = 0;
+};
+
+ZoneStats leftStats;
+ZoneStats rightStats;
+
 // DNS
 const byte DNS_PORT = 53;
 DNSServer dnsServer;
 
 Config config;
+uint32_t configSeq = 0;        // Sequence number of the newest committed config
 State state;
 WebServer server(80);  // Changed from 8080 to 80 for easier access
 
 // --- Forward Declarations ---
 void loadConfig();
 void saveConfig();
+void markConfigDirty();
+bool sanitizeConfig(Config& cfg);
+void serviceConfigStore();
 void updateConfig(String jsonStr);
+void sendConfigSnapshot(bool includeSecrets);
+bool importConfigSnapshot(JsonObject snapshot, String& error, int& applied);
 String getMainPage();
 String getBasicPage();
 String getManualPage();
@@ -159,24 +807,54 @@ String getChartsPage();
 String getSettingsPage();
 String getStatusJSON();
 String getConfigJSON();
-String getLogsJSON();
+void sendLogsJSON(uint32_t fromTs, uint32_t toTs, int limit);
 String getOtaStatusJSON();
 void setupWebServer();
 void readTemperatures();
+void updateZoneStats(ZoneStats& stats, float temp, float threshold, unsigned long now);
+void recordTemperatureLog();
+void initHistory();
+void historyAppend(const TemperatureLogEntry& entry);
+void initTempLog();
+void appendLogEntry(const TemperatureLogEntry& entry);
+TemperatureLogEntry readLogEntry(int index);
+void loadSetpointEvents();
+void flushHistory();
+void serviceHistory();
+void serviceTimeBase();
+uint32_t correctedTimestamp(uint32_t timestamp);
+uint32_t historyForEach(uint32_t fromTs, uint32_t toTs, std::function<bool(const TemperatureLogEntry&)> fn);
+String getHistoryInfoJSON();
+void initHistoryTiers();
+void historyTiersAppend(const TemperatureLogEntry& entry);
+void sendHistoryJSON(uint32_t fromTs, uint32_t toTs, String tierName);
+void serviceSensorsAndControl();
 void controlLogic();
-void stopCompressor();
+void stopCompressor(uint8_t reason = STOP_OTHER);
+void recordControlEvent(uint8_t type, uint8_t zone, uint8_t detail = 0);
+void flushControlEvents();
 void switchZone(int zone);
 void startCompressor(int zone);
 String getMainPage();
 void calculateNTCBeta();
+float updateSensorHealth(SensorHealth& health, const char* zoneName, int adc, float temp, unsigned long now);
+bool faultDutyActive(const SensorHealth& health, unsigned long now);
+float applyZoneFilter(ZoneFilter& filter, float measurement, unsigned long now);
+const char* sensorFaultName(SensorFault fault);
+void commitCalibrationPoint(int point, float actualTemp, float resistanceLeft, float resistanceRight);
+bool startCalibrationCapture(int point, float actualTemp, float varianceThreshold);
+void serviceCalibrationCapture();
+String getCalibrationCaptureJSON();
 float readNTCCalibrated(int pin, float avgResistanceLeft, float avgResistanceRight, bool isLeftSensor);
 
 // GitHub OTA Implementation
 GitHubRelease checkForUpdates();
 bool downloadAndInstallFirmware(String firmwareUrl);
-bool verifyFirmwareIntegrity();
+bool verifyFirmwareIntegrity(const uint8_t actual[32], const uint8_t expected[32]);
 bool rollbackFirmware();
 void initiateManualUpdate();
+void initOtaValidation();
+void serviceOtaValidation();
 
 // Simplified version comparison (assumes semantic versioning)
 bool isVersionNewer(String remoteVersion, String currentVersion) {
@@ -199,22 +877,38 @@ GitHubRelease checkForUpdates() {
   GitHubRelease result = {"", "", "", false, 0};
 
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("❌ No WiFi connection for update check");
+    LOGE(LOG_OTA, "No WiFi connection for update check");
     return result;
   }
 
   HTTPClient http;
   String url = "https://api.github.com/repos/" + String(GITHUB_OWNER) + "/" + String(GITHUB_REPO) + "/releases/latest";
 
-  Serial.println("🔍 Checking for firmware updates...");
-  Serial.printf("📡 URL: %s\n", url.c_str());
+  LOGI(LOG_OTA, "Checking for firmware updates...");
+  LOGD(LOG_OTA, "URL: %s", url.c_str());
 
   http.begin(url);
   http.addHeader("User-Agent", "ESP32-FridgeController/" + String(CURRENT_VERSION));
   http.setTimeout(15000);
+  if (releaseCache.valid) {
+    if (releaseCache.etag.length()) http.addHeader("If-None-Match", releaseCache.etag);
+    if (releaseCache.lastModified.length()) http.addHeader("If-Modified-Since", releaseCache.lastModified);
+  }
+  const char* headerKeys[] = {"ETag", "Last-Modified"};
+  http.collectHeaders(headerKeys, 2);
 
   int httpResponseCode = http.GET();
 
+  if (httpResponseCode == 304 && releaseCache.valid) {
+    http.end();
+    releaseCache.notModified++;
+    result = releaseCache.release;
+    result.isNewer = isVersionNewer(result.version, CURRENT_VERSION);
+    LOGI(LOG_OTA, "Release unchanged (%s), update available: %s",
+      result.version.c_str(), result.isNewer ? "YES" : "NO");
+    return result;
+  }
+
   if (httpResponseCode == 200) {
     // Use streaming to avoid loading entire response into memory
     WiFiClient* stream = http.getStreamPtr();
@@ -228,31 +922,40 @@ GitHubRelease checkForUpdates() {
     filterAssets["browser_download_url"] = true;
 
     // Parse with filter - uses much less memory than parsing everything
-    DynamicJsonDocument doc(3072);
+    DynamicJsonDocument doc(4096);
     DeserializationError error = deserializeJson(doc, *stream, DeserializationOption::Filter(filter));
 
     if (error) {
-      Serial.printf("❌ JSON parse error: %s\n", error.c_str());
-      Serial.printf("   Memory usage: %d bytes\n", doc.memoryUsage());
+      LOGE(LOG_OTA, "JSON parse error: %s", error.c_str());
+      LOGD(LOG_OTA, "Memory usage: %u bytes", (unsigned)doc.memoryUsage());
       http.end();
       return result;
     }
 
-    Serial.printf("✓ JSON parsed, memory used: %d bytes\n", doc.memoryUsage());
+    LOGD(LOG_OTA, "JSON parsed, memory used: %u bytes", (unsigned)doc.memoryUsage());
 
-    // Extract firmware download URL from assets
+    // Extract firmware download URL from assets, preferring the gzip-compressed image
     String firmwareUrl = "";
+    String compressedUrl = "";
     JsonArray assets = doc["assets"];
 
     for (JsonVariant asset : assets) {
       String assetName = asset["name"].as<String>();
-      if (assetName.startsWith("firmware-") && assetName.endsWith(".bin") &&
-          assetName.indexOf("bootloader") == -1 && assetName.indexOf("partitions") == -1) {
+      if (!assetName.startsWith("firmware-") ||
+          assetName.indexOf("bootloader") != -1 || assetName.indexOf("partitions") != -1) {
+        continue;
+      }
+      if (assetName.endsWith(".bin")) {
         firmwareUrl = asset["browser_download_url"].as<String>();
-        Serial.printf("📦 Found firmware: %s\n", assetName.c_str());
-        break;
+        LOGD(LOG_OTA, "Found firmware: %s", assetName.c_str());
+      } else if (assetName.endsWith(".bin.gz")) {
+        compressedUrl = asset["browser_download_url"].as<String>();
+        LOGD(LOG_OTA, "Found compressed firmware: %s", assetName.c_str());
       }
     }
+    if (compressedUrl.length() > 0 && compressedUrl == firmwareUrl + ".gz") {
+      firmwareUrl = compressedUrl;
+    }
 
     result.version = doc["tag_name"].as<String>();
     result.downloadUrl = firmwareUrl;
@@ -261,19 +964,23 @@ GitHubRelease checkForUpdates() {
     // Check if version is newer
     result.isNewer = isVersionNewer(result.version, CURRENT_VERSION);
 
-    Serial.printf("📋 Latest version: %s\n", result.version.c_str());
-    Serial.printf("📱 Current version: %s\n", CURRENT_VERSION);
-    Serial.printf("✅ Update available: %s\n", result.isNewer ? "YES" : "NO");
+    LOGI(LOG_OTA, "Latest version: %s, current: %s, update available: %s",
+      result.version.c_str(), CURRENT_VERSION, result.isNewer ? "YES" : "NO");
     if (firmwareUrl.length() > 0) {
-      Serial.printf("📥 Download URL: %s\n", firmwareUrl.c_str());
+      LOGD(LOG_OTA, "Download URL: %s", firmwareUrl.c_str());
     } else {
-      Serial.println("⚠️ No firmware asset found in release");
+      LOGW(LOG_OTA, "No firmware asset found in release");
     }
 
+    releaseCache.valid = true;
+    releaseCache.release = result;
+    releaseCache.etag = http.header("ETag");
+    releaseCache.lastModified = http.header("Last-Modified");
+
   } else {
-    Serial.printf("❌ HTTP error checking updates: %d\n", httpResponseCode);
+    LOGE(LOG_OTA, "HTTP error checking updates: %d", httpResponseCode);
     if (httpResponseCode == -1) {
-      Serial.println("   Possible network timeout");
+      LOGW(LOG_OTA, "Possible network timeout");
     }
   }
 
@@ -281,155 +988,612 @@ GitHubRelease checkForUpdates() {
   return result;
 }
 
-bool downloadAndInstallFirmware(String firmwareUrl) {
-  otaUpdateInProgress = true;
-  Serial.println("⬇️ Starting firmware download...");
+// Incremental SHA-256 of a firmware image, fed with each chunk as it is written to flash
+struct FirmwareHasher {
+  mbedtls_sha256_context ctx;
+  bool active = false;           // Between begin() and finish()/discard(); ctx holds resources
 
-  if (!firmwareUrl.length()) {
-    Serial.println("❌ No firmware URL provided");
-    otaUpdateInProgress = false;
-    return false;
+  void begin() {
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    active = true;
+  }
+  void update(const uint8_t* data, size_t len) {
+    mbedtls_sha256_update_ret(&ctx, data, len);
+  }
+  void finish(uint8_t digest[32]) {
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+    active = false;
+  }
+  // Release the context without a digest, for a transfer that fails part way
+  void discard() {
+    if (!active) return;
+    mbedtls_sha256_free(&ctx);
+    active = false;
+  }
+};
+
+void formatSha256(const uint8_t digest[32], char hex[65]) {
+  for (int i = 0; i < 32; i++) sprintf(hex + i * 2, "%02x", digest[i]);
+  hex[64] = '\0';
+}
+
+// Parse the leading 64 hex digits of a sha256sum line ("<hash>  firmware-x.bin")
+bool parseSha256(const String& text, uint8_t digest[32]) {
+  if (text.length() < 64) return false;
+  for (int i = 0; i < 32; i++) {
+    char pair[3] = {text[i * 2], text[i * 2 + 1], '\0'};
+    if (!isxdigit(pair[0]) || !isxdigit(pair[1])) return false;
+    digest[i] = (uint8_t)strtoul(pair, nullptr, 16);
   }
+  return true;
+}
 
+// Fetch the published checksum for an image; the release workflow names it <image>.sha256
+bool fetchFirmwareHash(const String& firmwareUrl, uint8_t digest[32]) {
   HTTPClient http;
-  Serial.printf("📡 Downloading from: %s\n", firmwareUrl.c_str());
+  http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
+  http.setRedirectLimit(5);
+  http.begin(firmwareUrl + ".sha256");
+  http.addHeader("User-Agent", "ESP32-FridgeController/" + String(CURRENT_VERSION));
+  http.setTimeout(15000);
+
+  int httpResponseCode = http.GET();
+  bool ok = httpResponseCode == 200 && parseSha256(http.getString(), digest);
+  http.end();
+  if (!ok) {
+    LOGE(LOG_OTA, "No usable SHA-256 checksum at %s.sha256 (HTTP %d)", firmwareUrl.c_str(), httpResponseCode);
+  }
+  return ok;
+}
+
+bool verifyFirmwareIntegrity(const uint8_t actual[32], const uint8_t expected[32]) {
+  char actualHex[65], expectedHex[65];
+  formatSha256(actual, actualHex);
+  formatSha256(expected, expectedHex);
+  if (memcmp(actual, expected, 32) != 0) {
+    LOGE(LOG_OTA, "SHA-256 mismatch: image %s, expected %s", actualHex, expectedHex);
+    return false;
+  }
+  LOGI(LOG_OTA, "SHA-256 verified: %s", actualHex);
+  return true;
+}
+
+// Streaming gzip decoder for compressed OTA images, using the ROM copy of miniz's tinfl.
+// Deflate can refer back up to 32 KB, so the output window has that size; it and the
+// decoder state are only allocated for the duration of an update. The gzip trailer is not
+// checked - the SHA-256 over the decompressed image covers it.
+struct GzipInflater {
+  enum Phase : uint8_t { GZ_FIXED, GZ_EXTRA_LEN, GZ_SKIP, GZ_NAME, GZ_COMMENT, GZ_BODY };
+
+  tinfl_decompressor* decomp = nullptr;
+  uint8_t* window = nullptr;
+  size_t windowPos = 0;
+  Phase phase = GZ_FIXED;
+  uint8_t header[10];
+  uint8_t headerLen = 0;
+  uint8_t flags = 0;           // Optional header parts still to skip
+  uint16_t skip = 0;
+  bool done = false;
+
+  bool begin() {
+    decomp = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    if (!decomp || !window) {
+      end();
+      return false;
+    }
+    tinfl_init(decomp);
+    return true;
+  }
+
+  void end() {
+    free(decomp);
+    free(window);
+    decomp = nullptr;
+    window = nullptr;
+  }
+
+  // Feed compressed bytes; decompressed output goes to sink. False on corrupt input or a sink failure.
+  bool feed(const uint8_t* in, size_t len, const std::function<bool(const uint8_t*, size_t)>& sink) {
+    while (len > 0 && phase != GZ_BODY) {
+      if (!headerByte(*in++)) return false;
+      len--;
+    }
 
+    bool moreOutput = false;
+    while (!done && (len > 0 || moreOutput)) {
+      size_t inSize = len;
+      size_t outSize = TINFL_LZ_DICT_SIZE - windowPos;
+      tinfl_status status = tinfl_decompress(decomp, in, &inSize, window, window + windowPos, &outSize,
+        TINFL_FLAG_HAS_MORE_INPUT);
+      in += inSize;
+      len -= inSize;
+      if (outSize > 0) {
+        if (!sink(window + windowPos, outSize)) return false;
+        windowPos = (windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+      }
+      if (status < TINFL_STATUS_DONE) return false;
+      done = status == TINFL_STATUS_DONE;
+      moreOutput = status == TINFL_STATUS_HAS_MORE_OUTPUT;  // Window full; drain it even without new input
+    }
+    return true;
+  }
+
+private:
+  void nextHeaderPhase() {
+    headerLen = 0;
+    skip = 0;
+    if (flags & 0x04) { flags &= ~0x04; phase = GZ_EXTRA_LEN; }        // FEXTRA
+    else if (flags & 0x08) { flags &= ~0x08; phase = GZ_NAME; }        // FNAME
+    else if (flags & 0x10) { flags &= ~0x10; phase = GZ_COMMENT; }     // FCOMMENT
+    else if (flags & 0x02) { flags &= ~0x02; phase = GZ_SKIP; skip = 2; }  // FHCRC
+    else phase = GZ_BODY;
+  }
+
+  bool headerByte(uint8_t b) {
+    switch (phase) {
+      case GZ_FIXED:
+        header[headerLen++] = b;
+        if (headerLen == sizeof(header)) {
+          if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) return false;  // Not gzip/deflate
+          flags = header[3];
+          nextHeaderPhase();
+        }
+        return true;
+      case GZ_EXTRA_LEN:
+        skip |= (uint16_t)b << (8 * headerLen++);
+        if (headerLen == 2) {
+          phase = GZ_SKIP;
+          if (skip == 0) nextHeaderPhase();
+        }
+        return true;
+      case GZ_SKIP:
+        if (--skip == 0) nextHeaderPhase();
+        return true;
+      case GZ_NAME:
+      case GZ_COMMENT:
+        if (b == 0) nextHeaderPhase();
+        return true;
+      case GZ_BODY:
+        return true;
+    }
+    return false;
+  }
+};
+
+// Wait between download attempts without letting the fridge go unattended
+void otaBackoffWait(unsigned long waitMs) {
+  unsigned long start = millis();
+  while (millis() - start < waitMs) {
+    serviceSensorsAndControl();
+    delay(10);
+  }
+}
+
+// One connection's worth of download, starting at otaProgress.written. The first response
+// fixes the download size and starts Update; later ones resume with a Range request. Each chunk
+// (decompressed first when inflater is set) is hashed and written in the same pass, so
+// verification needs no second read of the image and nothing beyond the chunk buffer (and the
+// inflate window) is held in RAM.
+OtaFetchResult fetchFirmwareRange(const String& firmwareUrl, FirmwareHasher& hasher, GzipInflater* inflater) {
+  HTTPClient http;
   // Configure HTTP client to follow redirects (GitHub uses redirects for asset downloads)
   http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
   http.setRedirectLimit(5);  // Allow up to 5 redirects
-  
+
   http.begin(firmwareUrl);
   http.addHeader("User-Agent", "ESP32-FridgeController/" + String(CURRENT_VERSION));
   http.addHeader("Accept", "application/octet-stream");  // Request binary data
   http.setTimeout(60000);  // 60 second timeout for large downloads
+  size_t offset = otaProgress.written;
+  if (offset > 0) http.addHeader("Range", "bytes=" + String((unsigned long)offset) + "-");
+  const char* headerKeys[] = {"Content-Range"};
+  http.collectHeaders(headerKeys, 1);
 
-  Serial.println("📡 Sending HTTP GET request...");
+  LOGD(LOG_OTA, "GET %s from byte %u", firmwareUrl.c_str(), (unsigned)offset);
   int httpResponseCode = http.GET();
-  Serial.printf("📡 HTTP Response: %d\n", httpResponseCode);
+  LOGD(LOG_OTA, "HTTP Response: %d", httpResponseCode);
 
-  if (httpResponseCode != 200) {
-    Serial.printf("❌ Download failed: HTTP %d\n", httpResponseCode);
+  if (httpResponseCode != 200 && httpResponseCode != 206) {
+    LOGE(LOG_OTA, "Download failed: HTTP %d", httpResponseCode);
     if (httpResponseCode == 302 || httpResponseCode == 301) {
-      Serial.println("   Redirect not followed - check HTTPClient configuration");
+      LOGW(LOG_OTA, "Redirect not followed - check HTTPClient configuration");
       String location = http.getLocation();
       if (location.length() > 0) {
-        Serial.printf("   Redirect location: %s\n", location.c_str());
+        LOGW(LOG_OTA, "Redirect location: %s", location.c_str());
       }
     }
     http.end();
-    otaUpdateInProgress = false;
-    return false;
+    // Connection errors and server-side trouble are worth retrying, a missing asset is not
+    return httpResponseCode < 0 || httpResponseCode >= 500 ? OTA_FETCH_RETRY : OTA_FETCH_FAILED;
   }
 
-  int contentLength = http.getSize();
-  Serial.printf("📏 Firmware size: %d bytes\n", contentLength);
+  // Update is started once per download: an attempt can begin it and then drop before the
+  // first byte, so the retry must not call begin() again (it refuses while a size is set)
+  size_t skip = 0;
+  if (otaProgress.total == 0) {
+    int contentLength = http.getSize();
+    LOGI(LOG_OTA, "Firmware size: %d bytes", contentLength);
+    if (httpResponseCode != 200 || contentLength <= 0 || contentLength > 2000000) {  // Max 2MB
+      LOGE(LOG_OTA, "Invalid content length");
+      http.end();
+      return OTA_FETCH_FAILED;
+    }
+    // A compressed image's final size is only in its trailer, so Update gets the whole partition
+    if (!Update.begin(inflater ? UPDATE_SIZE_UNKNOWN : contentLength)) {
+      LOGE(LOG_OTA, "Not enough space for OTA update: %s", Update.errorString());
+      http.end();
+      return OTA_FETCH_FAILED;
+    }
+    otaProgress.total = contentLength;
+    LOGI(LOG_OTA, "Starting OTA update...");
+  } else if (offset > 0 && httpResponseCode == 206) {
+    // "bytes <first>-<last>/<total>" must continue exactly where we stopped
+    String range = http.header("Content-Range");
+    int slash = range.indexOf('/');
+    if (!range.startsWith("bytes " + String((unsigned long)offset) + "-") || slash < 0 ||
+        strtoul(range.c_str() + slash + 1, nullptr, 10) != otaProgress.total) {
+      LOGE(LOG_OTA, "Unexpected Content-Range on resume: %s", range.c_str());
+      http.end();
+      return OTA_FETCH_FAILED;
+    }
+  } else {
+    // Full image again - a retry before any data, or a server ignoring Range: skip what we have
+    if ((size_t)http.getSize() != otaProgress.total) {
+      LOGE(LOG_OTA, "Image size changed during download");
+      http.end();
+      return OTA_FETCH_FAILED;
+    }
+    skip = offset;
+    if (skip > 0) LOGW(LOG_OTA, "Server does not support ranges - skipping %u bytes", (unsigned)skip);
+  }
 
-  if (contentLength <= 0 || contentLength > 2000000) {  // Max 2MB
-    Serial.println("❌ Invalid content length");
-    http.end();
+  WiFiClient * stream = http.getStreamPtr();
+  unsigned long lastData = millis();
+  while (otaProgress.written < otaProgress.total) {
+    size_t available = stream->available();
+    if (available == 0) {
+      if (!http.connected() || millis() - lastData > OTA_STALL_TIMEOUT_MS) break;
+      delay(1);
+      continue;
+    }
+    size_t remaining = skip > 0 ? skip : otaProgress.total - otaProgress.written;
+    size_t want = min(min(available, sizeof(otaChunk)), remaining);
+    size_t got = stream->readBytes(otaChunk, want);
+    if (got == 0) break;
+    lastData = millis();
+    if (skip > 0) {
+      skip -= got;
+      continue;
+    }
+    auto writeImage = [&](const uint8_t* data, size_t len) {
+      hasher.update(data, len);
+      otaProgress.imageBytes += len;
+      return Update.write((uint8_t*)data, len) == len;
+    };
+    bool ok = inflater ? inflater->feed(otaChunk, got, writeImage) : writeImage(otaChunk, got);
+    if (!ok) {
+      LOGE(LOG_OTA, "Image write failed at %u bytes: %s", (unsigned)otaProgress.written,
+        Update.hasError() ? Update.errorString() : "corrupt compressed data");
+      http.end();
+      return OTA_FETCH_FAILED;
+    }
+
+    size_t before = otaProgress.written * 100 / otaProgress.total;
+    otaProgress.written += got;
+    size_t percentage = otaProgress.written * 100 / otaProgress.total;
+    if (percentage / 25 != before / 25) {
+      LOGI(LOG_OTA, "Progress: %u%%", (unsigned)percentage);
+    }
+  }
+
+  http.end();
+  return otaProgress.written == otaProgress.total ? OTA_FETCH_DONE : OTA_FETCH_RETRY;
+}
+
+bool downloadAndInstallFirmware(String firmwareUrl) {
+  otaUpdateInProgress = true;
+  LOGI(LOG_OTA, "Starting firmware download...");
+  String version = releaseCache.valid && releaseCache.release.downloadUrl == firmwareUrl ? releaseCache.release.version : "";
+
+  if (!firmwareUrl.length()) {
+    LOGE(LOG_OTA, "No firmware URL provided");
     otaUpdateInProgress = false;
     return false;
   }
 
-  // Start OTA update with progress callback
-  if (!Update.begin(contentLength)) {
-    Serial.printf("❌ Not enough space for OTA update: %s\n", Update.errorString());
-    http.end();
+  // A .gz asset is the compressed form of the .bin next to it. Its checksum is the one of the
+  // .bin, checked against the decompressed output. Without heap for the window, fetch the .bin.
+  GzipInflater inflater;
+  bool compressed = firmwareUrl.endsWith(".gz");
+  String imageUrl = compressed ? firmwareUrl.substring(0, firmwareUrl.length() - 3) : firmwareUrl;
+  if (compressed && !inflater.begin()) {
+    LOGW(LOG_OTA, "No memory for decompression - downloading the uncompressed image");
+    compressed = false;
+    firmwareUrl = imageUrl;
+  }
+
+  // The checksum comes first so an image is never committed without something to verify against
+  uint8_t expectedHash[32];
+  if (!fetchFirmwareHash(imageUrl, expectedHash)) {
+    inflater.end();
+    LOGE(LOG_OTA, "Refusing update without a checksum");
     otaUpdateInProgress = false;
     return false;
   }
 
-  Serial.println("🚀 Starting OTA update...");
+  // A dropped connection resumes from the last byte handed to Update, after an increasing pause
+  otaProgress = OtaProgress();
+  otaProgress.startedAt = millis();
+  FirmwareHasher hasher;
+  hasher.begin();
+  OtaFetchResult result;
+  while ((result = fetchFirmwareRange(firmwareUrl, hasher, compressed ? &inflater : nullptr)) == OTA_FETCH_RETRY &&
+         otaProgress.resumes < OTA_MAX_RESUMES) {
+    otaProgress.resumes++;
+    unsigned long backoff = min(OTA_RETRY_BASE_MS << (otaProgress.resumes - 1), (unsigned long)OTA_RETRY_MAX_MS);
+    LOGW(LOG_OTA, "Download interrupted at %u/%u bytes - resuming in %lu s (attempt %u/%u)",
+      (unsigned)otaProgress.written, (unsigned)otaProgress.total, backoff / 1000,
+      (unsigned)otaProgress.resumes, (unsigned)OTA_MAX_RESUMES);
+    otaBackoffWait(backoff);
+  }
 
-  Update.onProgress([&](size_t done, size_t total) {
-    static size_t lastReportedProgress = 0;
-    size_t percentage = (done * 100) / total;
-    if (percentage % 25 == 0 && percentage != lastReportedProgress) {
-      Serial.printf("⚡ Progress: %d%%\n", percentage);
-      lastReportedProgress = percentage;
-    }
-  });
+  uint8_t actualHash[32];
+  hasher.finish(actualHash);
+  bool truncated = compressed && !inflater.done;
+  inflater.end();
 
-  WiFiClient * stream = http.getStreamPtr();
-  size_t written = Update.writeStream(*stream);
+  if (result == OTA_FETCH_DONE && truncated) {
+    LOGE(LOG_OTA, "Compressed image ended early");
+    result = OTA_FETCH_FAILED;
+  }
+  if (result != OTA_FETCH_DONE) {
+    LOGE(LOG_OTA, "Write failed. Written: %u, Expected: %u, Error: %s",
+      (unsigned)otaProgress.written, (unsigned)otaProgress.total, Update.errorString());
+    if (otaProgress.total > 0) Update.abort();
+    otaUpdateInProgress = false;
+    return false;
+  }
+  LOGI(LOG_OTA, "Download complete: %u bytes (%u bytes image) in %lu s with %u resumes",
+    (unsigned)otaProgress.total, (unsigned)otaProgress.imageBytes, (millis() - otaProgress.startedAt) / 1000,
+    (unsigned)otaProgress.resumes);
 
-  if (written != (size_t)contentLength) {
-    Serial.printf("❌ Write failed. Written: %d, Expected: %d\n", written, contentLength);
-    Serial.printf("   Error: %s\n", Update.errorString());
-    Update.abort();
-    http.end();
+  if (!verifyFirmwareIntegrity(actualHash, expectedHash)) {
+    Update.abort();  // Never mark a corrupted image bootable
     otaUpdateInProgress = false;
     return false;
   }
 
-  if (!Update.end()) {
-    Serial.printf("❌ OTA update failed: %s\n", Update.errorString());
-    http.end();
+  if (!Update.end(compressed)) {  // Size was unknown up front for compressed images
+    LOGE(LOG_OTA, "OTA update failed: %s", Update.errorString());
     otaUpdateInProgress = false;
     return false;
   }
 
   if (!Update.isFinished()) {
-    Serial.println("❌ Update not finished - something went wrong!");
-    http.end();
+    LOGE(LOG_OTA, "Update not finished - something went wrong!");
     otaUpdateInProgress = false;
     return false;
   }
 
-  http.end();
-
-  // Update version file
+  // Update version file; the release this image came from was parsed when it was found
   File file = LittleFS.open("/version.txt", "w");
   if (file) {
-    GitHubRelease latest = checkForUpdates();  // Get the latest version
-    file.printf("version=%s\n", latest.version.length() ? latest.version.c_str() : "unknown");
+    file.printf("version=%s\n", version.length() ? version.c_str() : "unknown");
     file.printf("build_time=%lu\n", millis());
     file.printf("updated_from_github=true\n");
     file.close();
-    Serial.println("✅ Version file updated");
+    LOGI(LOG_OTA, "Version file updated");
   }
 
-  Serial.println("✅ OTA update completed successfully!");
+  LOGI(LOG_OTA, "OTA update completed successfully!");
   otaUpdateInProgress = false;
   return true;
 }
 
-bool verifyFirmwareIntegrity() {
-  // Basic integrity check - in production you might want to implement
-  // SHA256 verification against known good hash
-  return true;  // Placeholder
-}
+// ---- Local firmware upload ----
+// POST /api/ota/upload streams a raw or multipart body straight into Update, hashing it on the
+// way, so an image can be pushed from a laptop on the LAN without internet access.
+enum OtaUploadPhase : uint8_t {
+  OTA_UPLOAD_START,
+  OTA_UPLOAD_WRITE,
+  OTA_UPLOAD_END,
+  OTA_UPLOAD_ABORTED,
+};
 
-bool rollbackFirmware() {
-  // In a production system, you might keep a backup of the previous firmware
-  // For now, just disable auto-updates to prevent further issues
-  config.autoUpdatesEnabled = false;
-  saveConfig();
-  Serial.println("⚠️ Firmware rollback initiated - auto-updates disabled");
-  return true;
+struct OtaUploadState {
+  bool active = false;           // Update.begin() succeeded for this request
+  bool ok = false;               // Image verified and committed
+  int status = 400;              // HTTP status to answer with when !ok
+  String error;
+  uint8_t expectedHash[32];
+  FirmwareHasher hasher;
+};
+OtaUploadState otaUpload;
+
+void failOtaUpload(int status, const String& error) {
+  if (otaUpload.active) Update.abort();
+  otaUpload.hasher.discard();
+  otaUpload.active = false;
+  otaUpload.status = status;
+  otaUpload.error = error;
+  otaUpdateInProgress = false;
+  LOGE(LOG_OTA, "Firmware upload rejected: %s", error.c_str());
 }
 
-void initiateManualUpdate() {
-  Serial.println("🔄 Manual update initiated");
-  GitHubRelease update = checkForUpdates();
+// Called for every piece of the request body. The compressor has to be off, as for automatic
+// updates; the control loop does not run while the body is being received, so it stays off.
+void otaUploadStep(uint8_t phase, const uint8_t* data, size_t len) {
+  switch (phase) {
+    case OTA_UPLOAD_START:
+      otaUpload.hasher.discard();  // A previous upload that ended without an ABORTED call
+      otaUpload = OtaUploadState();
+      if (state.compressorOn) {
+        failOtaUpload(409, "compressor is running - stop it first");
+        return;
+      }
+      if (otaUpdateInProgress) {
+        failOtaUpload(409, "another update is in progress");
+        return;
+      }
+      if (otaValidation.pending) {
+        failOtaUpload(409, "running firmware is not validated yet");
+        return;
+      }
+      if (!parseSha256(server.arg("sha256"), otaUpload.expectedHash)) {
+        failOtaUpload(400, "sha256 query parameter required");
+        return;
+      }
+      if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
+        failOtaUpload(500, String("cannot start update: ") + Update.errorString());
+        return;
+      }
+      otaUpdateInProgress = true;
+      otaUpload.active = true;
+      otaUpload.hasher.begin();
+      otaProgress = OtaProgress();
+      otaProgress.startedAt = millis();
+      otaProgress.total = server.header("Content-Length").toInt();  // Includes multipart framing
+      LOGI(LOG_OTA, "Firmware upload started");
+      return;
 
-  if (update.isNewer) {
-    Serial.printf("📦 Updating to version %s\n", update.version.c_str());
-    if (downloadAndInstallFirmware(update.downloadUrl)) {
-      Serial.println("✅ Manual update successful - restarting...");
-      delay(2000);
-      ESP.restart();
-    } else {
-      Serial.println("❌ Manual update failed");
+    case OTA_UPLOAD_WRITE: {
+      if (!otaUpload.active) return;
+      otaUpload.hasher.update(data, len);
+      if (Update.write((uint8_t*)data, len) != len) {
+        failOtaUpload(500, String("flash write failed: ") + Update.errorString());
+        return;
+      }
+      size_t before = otaProgress.imageBytes / (256 * 1024);
+      otaProgress.written += len;
+      otaProgress.imageBytes += len;
+      if (otaProgress.imageBytes / (256 * 1024) != before) {
+        LOGI(LOG_OTA, "Upload progress: %u KB", (unsigned)(otaProgress.imageBytes / 1024));
+      }
+      return;
     }
-  } else {
-    Serial.println("✅ Already on latest version");
-  }
-}
+
+    case OTA_UPLOAD_END: {
+      if (!otaUpload.active) return;
+      uint8_t actualHash[32];
+      otaUpload.hasher.finish(actualHash);
+      if (!verifyFirmwareIntegrity(actualHash, otaUpload.expectedHash)) {
+        failOtaUpload(400, "SHA-256 mismatch");
+        return;
+      }
+      if (!Update.end(true)) {
+        failOtaUpload(400, String("invalid image: ") + Update.errorString());
+        return;
+      }
+      otaUpload.active = false;
+      otaUpload.ok = true;
+      otaUpdateInProgress = false;
+      LOGI(LOG_OTA, "Firmware upload complete: %u bytes in %lu s",
+        (unsigned)otaProgress.imageBytes, (millis() - otaProgress.startedAt) / 1000);
+      return;
+    }
+
+    case OTA_UPLOAD_ABORTED:
+      if (otaUpload.active) failOtaUpload(400, "upload aborted");
+      return;
+  }
+}
+
+// Keep a freshly installed image in pending-verify state past initArduino(); it is marked
+// valid by serviceOtaValidation() once the self-test passes, otherwise the bootloader reverts.
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+// Revert to the previous image. Only possible while this image is still pending
+// verification; esp_ota_mark_app_invalid_rollback_and_reboot() does not return on success.
+bool rollbackFirmware() {
+  if (!esp_ota_check_rollback_is_possible()) {
+    LOGE(LOG_OTA, "Firmware rollback not possible - no valid previous image");
+    return false;
+  }
+  LOGW(LOG_OTA, "Firmware rollback initiated - rebooting into the previous image");
+  recordControlEvent(EVT_FIRMWARE, EVENT_ZONE_NONE, FIRMWARE_ROLLED_BACK);
+  flushHistory();
+  flushControlEvents();
+  saveConfig();
+  delay(500);
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+  LOGE(LOG_OTA, "Firmware rollback failed");
+  return false;
+}
+
+void initOtaValidation() {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  esp_ota_img_states_t imageState;
+  if (running && esp_ota_get_state_partition(running, &imageState) == ESP_OK &&
+      imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+    otaValidation.pending = true;
+    LOGW(LOG_OTA, "New firmware in %s pending verification - running self-test", running->label);
+  }
+
+  const esp_partition_t* invalid = esp_ota_get_last_invalid_partition();
+  if (invalid) {
+    LOGW(LOG_OTA, "Image in %s was rejected earlier and rolled back", invalid->label);
+  }
+}
+
+// Self-test for a pending image: sensors of enabled zones giving good readings, the control tick
+// running and the web server started. Passing marks the image valid; running out of time
+// rolls back. A crash or watchdog reset before then rolls back through the bootloader.
+void serviceOtaValidation() {
+  if (!otaValidation.pending) return;
+  unsigned long now = millis();
+
+  // Only zones in use need a working sensor; TESTING_MODE simulates readings and never
+  // updates sensor health, so there is nothing to check
+  bool leftOk = !config.leftEnabled || (leftHealth.hasGood && !leftHealth.faulted);
+  bool rightOk = !config.rightEnabled || (rightHealth.hasGood && !rightHealth.faulted);
+  bool sensorsOk = TESTING_MODE || (leftOk && rightOk);
+  bool controlOk = otaValidation.controlTicks >= OTA_VALIDATE_CONTROL_TICKS;
+  if (now >= OTA_VALIDATE_MIN_MS && sensorsOk && controlOk && otaValidation.webServerUp) {
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+      otaValidation.pending = false;
+      LOGI(LOG_OTA, "Firmware self-test passed - image marked valid");
+      recordControlEvent(EVT_FIRMWARE, EVENT_ZONE_NONE, FIRMWARE_VALIDATED);
+    }
+    return;
+  }
+
+  if (now >= OTA_VALIDATE_TIMEOUT_MS) {
+    LOGE(LOG_OTA, "Firmware self-test failed (sensors %s, control ticks %lu, web server %s)",
+      sensorsOk ? "ok" : "bad", (unsigned long)otaValidation.controlTicks, otaValidation.webServerUp ? "up" : "down");
+    otaValidation.pending = false;
+    rollbackFirmware();
+  }
+}
+
+void initiateManualUpdate() {
+  LOGI(LOG_OTA, "Manual update initiated");
+  GitHubRelease update = checkForUpdates();
+
+  if (update.isNewer) {
+    LOGI(LOG_OTA, "Updating to version %s", update.version.c_str());
+    if (downloadAndInstallFirmware(update.downloadUrl)) {
+      LOGI(LOG_OTA, "Manual update successful - restarting...");
+      flushHistory();
+      flushControlEvents();
+      saveConfig();
+      delay(2000);
+      ESP.restart();
+    } else {
+      LOGE(LOG_OTA, "Manual update failed");
+    }
+  } else {
+    LOGI(LOG_OTA, "Already on latest version");
+  }
+}
 
 // OTA Status API endpoint
 String getOtaStatusJSON() {
-  DynamicJsonDocument doc(512);
+  DynamicJsonDocument doc(768);
 
   doc["currentVersion"] = CURRENT_VERSION;
   doc["autoUpdatesEnabled"] = config.autoUpdatesEnabled;
@@ -438,6 +1602,22 @@ String getOtaStatusJSON() {
   doc["githubOwner"] = GITHUB_OWNER;
   doc["githubRepo"] = GITHUB_REPO;
   doc["checkIntervalMinutes"] = CHECK_INTERVAL_MINUTES;
+  if (releaseCache.valid) {
+    doc["latestVersion"] = releaseCache.release.version;
+    doc["notModifiedPolls"] = releaseCache.notModified;
+  }
+  doc["pendingVerify"] = otaValidation.pending;
+  if (otaProgress.startedAt) {
+    JsonObject download = doc.createNestedObject("download");
+    download["written"] = otaProgress.written;
+    download["total"] = otaProgress.total;
+    download["imageBytes"] = otaProgress.imageBytes;
+    download["resumes"] = otaProgress.resumes;
+  }
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  if (running) doc["runningPartition"] = running->label;
+  const esp_partition_t* invalid = esp_ota_get_last_invalid_partition();
+  if (invalid) doc["rolledBackFrom"] = invalid->label;
 
   // Read version file if exists
   if (LittleFS.exists("/version.txt")) {
@@ -462,6 +1642,7 @@ String getOtaStatusJSON() {
 
 void setup() {
   Serial.begin(115200);
+  initLogging();
 
   Serial.println("Testing ADC pins (GPIO 32-39):");
   for(int pin = 32; pin <= 39; pin++) {
@@ -479,16 +1660,21 @@ void setup() {
   digitalWrite(SOLENOID_PIN, LOW);    // Left zone (default)
   digitalWrite(LED_PIN, LOW);
   
-  // Initialize EEPROM and load config - increased size for calibration data
+  // Config lives in NVS; EEPROM is only read to migrate the legacy struct image
   EEPROM.begin(1024);
   loadConfig();
+  initTempLog();
   
-  // Initialize LittleFS (optional, for compatibility)
-  if (!LittleFS.begin(false)) {
-    Serial.println("LittleFS initialization failed - this is OK since we use embedded web files");
+  // Initialize LittleFS - web files are embedded, but the temperature history lives here,
+  // so an unformatted partition is formatted rather than left unused
+  if (!LittleFS.begin(true)) {
+    Serial.println("LittleFS initialization failed - persistent history disabled");
   } else {
-    Serial.println("LittleFS initialized (optional)");
+    Serial.println("LittleFS initialized");
+    initHistory();
   }
+  recordControlEvent(EVT_BOOT, EVENT_ZONE_NONE);
+  initOtaValidation();
 
   Serial.println("\n================================");
   Serial.println("🌐 DUAL ZONE FRIDGE CONTROLLER");
@@ -624,6 +1810,10 @@ void setup() {
   // Initialize OTA
   Serial.println("\n--- OTA Setup ---");
   ArduinoOTA.setHostname("FridgeController");
+  ArduinoOTA.onStart([]() {  // Keep staged history and events across the reboot
+    flushHistory();
+    flushControlEvents();
+  });
   ArduinoOTA.begin();
   Serial.println("✓ OTA ready for remote firmware updates");
   Serial.printf("👉 OTA: http://%s.local\n", ArduinoOTA.getHostname());
@@ -636,6 +1826,7 @@ void setup() {
   setupWebServer();
   
   server.begin();
+  otaValidation.webServerUp = true;
   Serial.println("✓ Web server started on port 80");
   Serial.println("\n--- WiFi Config Portal ---");
   Serial.println("ℹ️ WiFi configuration available on port 8080");
@@ -671,12 +1862,12 @@ void loop() {
   static unsigned long lastWiFiCheck = 0;
   if (millis() - lastWiFiCheck > 30000) {  // Check every 30 seconds
     if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("WiFi disconnected, attempting to reconnect...");
+      LOGI(LOG_NET, "WiFi disconnected, attempting to reconnect...");
       
       // Try each configured network in priority order
       for (int i = 0; i < 5; i++) {
         if (config.wifiNetworks[i].enabled && strlen(config.wifiNetworks[i].ssid) > 0) {
-          Serial.printf("Trying network: %s\n", config.wifiNetworks[i].ssid);
+          LOGD(LOG_NET, "Trying network: %s", config.wifiNetworks[i].ssid);
           WiFi.begin(config.wifiNetworks[i].ssid, config.wifiNetworks[i].password);
           
           // Wait up to 5 seconds for connection
@@ -687,7 +1878,7 @@ void loop() {
           }
           
           if (WiFi.status() == WL_CONNECTED) {
-            Serial.printf("Reconnected to: %s\n", config.wifiNetworks[i].ssid);
+            LOGI(LOG_NET, "Reconnected to: %s", config.wifiNetworks[i].ssid);
             break;
           }
         }
@@ -700,44 +1891,46 @@ void loop() {
 
   dnsServer.processNextRequest();
 
-  // Read temperatures every 2 seconds
-  if (millis() - state.lastTempRead > 2000) {
-    readTemperatures();
-    state.lastTempRead = millis();
-  }
+  // Sample sensors for a pending calibration capture
+  serviceCalibrationCapture();
 
-  // Main control logic (only if not in manual mode)
-  if (!state.manualMode) {
-    controlLogic();
-  }
+  // Sensor sampling, control and logging at their configured rates
+  serviceSensorsAndControl();
+  serviceTimeBase();
+  serviceHistory();
+  serviceConfigStore();
+  serviceOtaValidation();
 
   // Check for firmware updates every CHECK_INTERVAL_MINUTES
   if (WiFi.status() == WL_CONNECTED && config.autoUpdatesEnabled &&
       millis() - lastUpdateCheck > (CHECK_INTERVAL_MINUTES * 60UL * 1000UL) &&
       !otaUpdateInProgress &&
+      !otaValidation.pending &&  // Finish validating this image first
       !state.compressorOn &&  // Only update when compressor is OFF (safe)
       millis() > (5 * 60 * 1000)) {  // Wait 5 minutes after boot before first check
 
-    Serial.println("\n🔄 Automatic firmware update check...");
+    LOGI(LOG_OTA, "Automatic firmware update check...");
     GitHubRelease update = checkForUpdates();
 
     if (update.isNewer) {
-      Serial.printf("📦 New firmware available: %s\n", update.version.c_str());
-      Serial.println("⬇️ Starting automatic update...");
+      LOGI(LOG_OTA, "New firmware available: %s", update.version.c_str());
+      LOGI(LOG_OTA, "Starting automatic update...");
 
       if (downloadAndInstallFirmware(update.downloadUrl)) {
-        Serial.println("✅ Firmware update successful!");
-        Serial.println("🔄 ESP32 restarting in 3 seconds...");
+        LOGI(LOG_OTA, "Firmware update successful!");
+        LOGI(LOG_OTA, "ESP32 restarting in 3 seconds...");
+        flushHistory();
+        flushControlEvents();
+        saveConfig();
         delay(3000);
         ESP.restart();
       } else {
-        Serial.println("❌ Firmware update failed!");
-        rollbackFirmware();
+        LOGE(LOG_OTA, "Firmware update failed!");
         // Try again in 24 hours
         lastUpdateCheck = millis() - (CHECK_INTERVAL_MINUTES * 60UL * 1000UL) + (24 * 60 * 60UL * 1000UL);
       }
     } else {
-      Serial.println("✅ Firmware is up to date");
+      LOGI(LOG_OTA, "Firmware is up to date");
     }
 
     lastUpdateCheck = millis();
@@ -746,7 +1939,7 @@ void loop() {
   // Update LED status
   digitalWrite(LED_PIN, state.compressorOn);
 
-  delay(100);
+  delay(5);  // Short yield - sampling runs at up to sampleIntervalMs
 }
 
 // Calculate Beta coefficient from two-point calibration
@@ -771,19 +1964,178 @@ void calculateNTCBeta() {
     }
 
     config.ntcCalibrated = true;
-    Serial.printf("NTC calibration completed: Beta=%.1f, Nominal R=%.1f at %.1f°C\n",
+    LOGI(LOG_SENSOR, "NTC calibration completed: Beta=%.1f, Nominal R=%.1f at %.1f°C",
       config.customBCoefficient, config.customNominalResistance, config.customNominalTemp);
   }
 }
 
+// Store a calibration point and, for point 2, derive the beta coefficient
+void commitCalibrationPoint(int point, float actualTemp, float resistanceLeft, float resistanceRight) {
+  if (point == 1) {
+    config.calPoint1ResistanceLeft = resistanceLeft;
+    config.calPoint1ResistanceRight = resistanceRight;
+    config.calPoint1Temp = actualTemp;
+  } else {
+    config.calPoint2ResistanceLeft = resistanceLeft;
+    config.calPoint2ResistanceRight = resistanceRight;
+    config.calPoint2Temp = actualTemp;
+    calculateNTCBeta();
+  }
+  markConfigDirty();
+
+  LOGI(LOG_SENSOR, "Calibration Point %d set: %.1f°C, R_left=%.1f, R_right=%.1f",
+    point, actualTemp, resistanceLeft, resistanceRight);
+}
+
+// Begin sampling both sensors until the readings settle
+bool startCalibrationCapture(int point, float actualTemp, float varianceThreshold) {
+  if (point != 1 && point != 2) return false;
+
+  calCapture = CalibrationCapture();
+  calCapture.active = true;
+  calCapture.point = point;
+  calCapture.actualTemp = actualTemp;
+  calCapture.varianceThreshold = varianceThreshold > 0 ? varianceThreshold : CAL_CAPTURE_VARIANCE_MAX;
+  calCapture.startedAt = millis();
+  calCapture.result = "sampling";
+
+  LOGI(LOG_SENSOR, "Calibration capture started for point %d (%.1f°C, variance <= %.2f)",
+    point, actualTemp, calCapture.varianceThreshold);
+  return true;
+}
+
+// Called from loop(): take one sample per CAL_CAPTURE_SAMPLE_MS and commit once stable
+// Population variance of the window. The difference is taken exactly in integers: as
+// sumSq/n - mean^2 in float, both terms are ~1e7 for mid-scale readings and rounding
+// alone is comparable to the stability threshold.
+float windowVariance(long sum, int64_t sumSq, int count) {
+  int64_t n = count;
+  return (float)(n * sumSq - (int64_t)sum * sum) / (float)(n * n);
+}
+
+void serviceCalibrationCapture() {
+  if (!calCapture.active) return;
+
+  unsigned long now = millis();
+  if (now - calCapture.lastSample < CAL_CAPTURE_SAMPLE_MS) return;
+  calCapture.lastSample = now;
+
+  if (now - calCapture.startedAt > CAL_CAPTURE_TIMEOUT_MS) {
+    calCapture.active = false;
+    calCapture.result = "timeout";
+    LOGW(LOG_SENSOR, "Calibration capture for point %d timed out (variance L=%.2f R=%.2f)",
+      calCapture.point, calCapture.leftVariance, calCapture.rightVariance);
+    return;
+  }
+
+  int leftReading = analogRead(NTC_LEFT_PIN);
+  int rightReading = analogRead(NTC_RIGHT_PIN);
+
+  // Drop the oldest sample once the window is full
+  int slot = calCapture.windowIndex;
+  if (calCapture.windowCount == CAL_CAPTURE_WINDOW) {
+    int oldLeft = calCapture.leftWindow[slot];
+    int oldRight = calCapture.rightWindow[slot];
+    calCapture.leftSum -= oldLeft;
+    calCapture.rightSum -= oldRight;
+    calCapture.leftSumSq -= (int64_t)oldLeft * oldLeft;
+    calCapture.rightSumSq -= (int64_t)oldRight * oldRight;
+  } else {
+    calCapture.windowCount++;
+  }
+
+  calCapture.leftWindow[slot] = leftReading;
+  calCapture.rightWindow[slot] = rightReading;
+  calCapture.leftSum += leftReading;
+  calCapture.rightSum += rightReading;
+  calCapture.leftSumSq += (int64_t)leftReading * leftReading;
+  calCapture.rightSumSq += (int64_t)rightReading * rightReading;
+  calCapture.windowIndex = (slot + 1) % CAL_CAPTURE_WINDOW;
+  calCapture.totalSamples++;
+
+  float n = calCapture.windowCount;
+  float leftMean = calCapture.leftSum / n;
+  float rightMean = calCapture.rightSum / n;
+  calCapture.leftVariance = windowVariance(calCapture.leftSum, calCapture.leftSumSq, calCapture.windowCount);
+  calCapture.rightVariance = windowVariance(calCapture.rightSum, calCapture.rightSumSq, calCapture.windowCount);
+
+  if (calCapture.windowCount < CAL_CAPTURE_WINDOW) return;
+  if (calCapture.leftVariance > calCapture.varianceThreshold ||
+      calCapture.rightVariance > calCapture.varianceThreshold) return;
+
+  // Readings at the ADC rails mean an open or shorted sensor - don't commit them
+  if (leftMean < 1.0 || leftMean > 4094.0 || rightMean < 1.0 || rightMean > 4094.0) {
+    calCapture.active = false;
+    calCapture.result = "failed";
+    LOGW(LOG_SENSOR, "Calibration capture failed: sensor reading at ADC limit (L=%.1f R=%.1f)", leftMean, rightMean);
+    return;
+  }
+
+  calCapture.resistanceLeft = SERIES_RESISTOR * (4095.0 / leftMean - 1.0);
+  calCapture.resistanceRight = SERIES_RESISTOR * (4095.0 / rightMean - 1.0);
+  calCapture.active = false;
+  calCapture.result = "complete";
+
+  commitCalibrationPoint(calCapture.point, calCapture.actualTemp,
+    calCapture.resistanceLeft, calCapture.resistanceRight);
+}
+
+String getCalibrationCaptureJSON() {
+  DynamicJsonDocument doc(512);
+  doc["active"] = calCapture.active;
+  doc["result"] = calCapture.result;
+  doc["point"] = calCapture.point;
+  doc["actualTemp"] = calCapture.actualTemp;
+  doc["samples"] = calCapture.totalSamples;
+  doc["windowFill"] = calCapture.windowCount;
+  doc["windowSize"] = CAL_CAPTURE_WINDOW;
+  doc["leftVariance"] = calCapture.leftVariance;
+  doc["rightVariance"] = calCapture.rightVariance;
+  doc["varianceThreshold"] = calCapture.varianceThreshold;
+  doc["elapsed"] = calCapture.startedAt ? (millis() - calCapture.startedAt) / 1000 : 0;
+
+  // Window fill counts for the first half, settling towards the threshold for the rest
+  int progress = 0;
+  if (calCapture.result == "complete") {
+    progress = 100;
+  } else if (calCapture.windowCount > 0) {
+    progress = 50 * calCapture.windowCount / CAL_CAPTURE_WINDOW;
+    if (calCapture.windowCount == CAL_CAPTURE_WINDOW) {
+      float worst = max(calCapture.leftVariance, calCapture.rightVariance);
+      float settle = worst > 0 ? calCapture.varianceThreshold / worst : 1.0;
+      progress += (int)(49 * min(settle, 1.0f));
+    }
+  }
+  doc["progress"] = progress;
+
+  if (calCapture.result == "complete") {
+    doc["resistanceLeft"] = calCapture.resistanceLeft;
+    doc["resistanceRight"] = calCapture.resistanceRight;
+    if (calCapture.point == 2) {
+      doc["calibrated"] = config.ntcCalibrated;
+      doc["beta"] = config.customBCoefficient;
+    }
+  }
+
+  String output;
+  serializeJson(doc, output);
+  return output;
+}
+
 // Read NTC with optional custom calibration
-float readNTC(int pin) {
+float readNTC(int pin, int* adcOut = nullptr) {
   int reading = analogRead(pin);
+  if (adcOut) *adcOut = reading;
+
+  // An open or shorted NTC drives the divider to a rail - don't divide by zero or take log(0)
+  if (reading <= 0 || reading >= 4095) {
+    LOGD(LOG_SENSOR, "NTC Pin %d: ADC=%d at rail, no temperature", pin, reading);
+    return NAN;
+  }
+
   float resistance = SERIES_RESISTOR * (4095.0 / reading - 1.0);
 
   // Debug output
-  Serial.printf("NTC Pin %d: ADC=%d, Resistance=%.1f ohm", pin, reading, resistance);
-
   float finalTemp;
 
   if (config.ntcCalibrated) {
@@ -796,7 +2148,8 @@ float readNTC(int pin) {
     steinhart -= 273.15;
 
     finalTemp = steinhart + config.tempOffset;
-    Serial.printf(" Calibrated: %.2f°C (Beta=%.1f)", finalTemp, config.customBCoefficient);
+    LOGD(LOG_SENSOR, "NTC Pin %d: ADC=%d, Resistance=%.1f ohm Calibrated: %.2f°C (Beta=%.1f)",
+      pin, reading, resistance, finalTemp, config.customBCoefficient);
   } else {
     // Use default values
     float steinhart = resistance / THERMISTOR_NOMINAL;
@@ -806,60 +2159,1596 @@ float readNTC(int pin) {
     steinhart = 1.0 / steinhart;
     steinhart -= 273.15;
 
-    finalTemp = steinhart + config.tempOffset;
-    Serial.printf(" Default: %.2f°C (raw:%.2f, offset:%.1f)", finalTemp, steinhart, config.tempOffset);
+    finalTemp = steinhart + config.tempOffset;
+    LOGD(LOG_SENSOR, "NTC Pin %d: ADC=%d, Resistance=%.1f ohm Default: %.2f°C (raw:%.2f, offset:%.1f)",
+      pin, reading, resistance, finalTemp, steinhart, config.tempOffset);
+  }
+
+  return finalTemp;
+}
+
+const char* sensorFaultName(SensorFault fault) {
+  switch (fault) {
+    case SENSOR_OPEN: return "open";
+    case SENSOR_SHORT: return "short";
+    case SENSOR_OUT_OF_RANGE: return "out_of_range";
+    case SENSOR_STUCK: return "stuck";
+    case SENSOR_RATE: return "rate";
+    default: return "ok";
+  }
+}
+
+// Classify one reading, debounce faults and return the temperature the controller should see:
+// the reading when healthy, the last good value while a fault is pending, NAN once faulted
+float updateSensorHealth(SensorHealth& health, const char* zoneName, int adc, float temp, unsigned long now) {
+  SensorFault reading = SENSOR_OK;
+
+  if (adc <= SENSOR_ADC_OPEN_MAX) {
+    reading = SENSOR_OPEN;
+  } else if (adc >= SENSOR_ADC_SHORT_MIN) {
+    reading = SENSOR_SHORT;
+  } else if (isnan(temp) || temp < SENSOR_TEMP_MIN || temp > SENSOR_TEMP_MAX) {
+    reading = SENSOR_OUT_OF_RANGE;
+  } else if (health.hasGood &&
+             fabs(temp - health.lastGoodTemp) > SENSOR_MAX_RATE * (now - health.lastGoodTime) / 1000.0 + SENSOR_RATE_NOISE) {
+    reading = SENSOR_RATE;
+  }
+
+  // A live ADC always shows some noise; a bit-identical value for a long time means a dead channel
+  if (adc != health.lastAdc) {
+    health.lastAdc = adc;
+    health.adcUnchangedSince = now;
+  } else if (reading == SENSOR_OK && now - health.adcUnchangedSince > SENSOR_STUCK_MS) {
+    reading = SENSOR_STUCK;
+  }
+
+  health.lastReading = reading;
+
+  if (reading == SENSOR_OK) {
+    health.badCount = 0;
+    if (health.goodCount++ == 0) health.goodSince = now;
+    health.hasGood = true;
+    health.lastGoodTemp = temp;
+    health.lastGoodTime = now;
+
+    if (health.faulted && health.goodCount >= SENSOR_RECOVER_COUNT && now - health.goodSince >= SENSOR_RECOVER_MS) {
+      health.faulted = false;
+      health.fault = SENSOR_OK;
+      recordControlEvent(EVT_SENSOR_RECOVERED, &health == &rightHealth ? 1 : 0);
+      LOGI(LOG_SENSOR, "%s sensor recovered", zoneName);
+    }
+  } else {
+    health.goodCount = 0;
+    if (health.badCount++ == 0) health.badSince = now;
+
+    if (!health.faulted && health.badCount >= SENSOR_FAULT_DEBOUNCE && now - health.badSince >= SENSOR_FAULT_DEBOUNCE_MS) {
+      health.faulted = true;
+      health.fault = reading;
+      health.faultSince = now;
+      health.faultEvents++;
+      recordControlEvent(EVT_SENSOR_FAULT, &health == &rightHealth ? 1 : 0, reading);
+      LOGW(LOG_SENSOR, "%s sensor fault: %s (ADC=%d) - using timed fallback cycle",
+        zoneName, sensorFaultName(reading), adc);
+    }
+  }
+
+  if (health.faulted) return NAN;
+  if (reading != SENSOR_OK) return health.hasGood ? health.lastGoodTemp : NAN;
+  return temp;
+}
+
+// Timed fallback for a faulted zone: cool for FAULT_DUTY_ON_MIN out of every FAULT_DUTY_PERIOD_MIN
+bool faultDutyActive(const SensorHealth& health, unsigned long now) {
+  unsigned long period = (unsigned long)(FAULT_DUTY_PERIOD_MIN * 60000);
+  unsigned long onTime = (unsigned long)(FAULT_DUTY_ON_MIN * 60000);
+  return (now - health.faultSince) % period < onTime;
+}
+
+// Smooth one zone's readings. NAN (faulted sensor) passes through and restarts the filter.
+float applyZoneFilter(ZoneFilter& filter, float measurement, unsigned long now) {
+  if (isnan(measurement)) {
+    filter.initialized = false;
+    return NAN;
+  }
+
+  if (config.filterMode == FILTER_NONE || !filter.initialized) {
+    filter.initialized = true;
+    filter.value = measurement;
+    filter.rate = 0.0;
+    filter.p00 = config.kalmanMeasurementNoise;
+    filter.p01 = 0.0;
+    filter.p11 = config.kalmanProcessNoise;
+    filter.lastUpdate = now;
+    return measurement;
+  }
+
+  float dt = (now - filter.lastUpdate) / 1000.0;
+  filter.lastUpdate = now;
+  if (dt <= 0) return filter.value;
+
+  if (config.filterMode == FILTER_EMA) {
+    float alpha = 1.0 - expf(-dt / config.filterTimeConstant);
+    filter.value += alpha * (measurement - filter.value);
+    return filter.value;
+  }
+
+  // Kalman: constant-rate model, state [temperature, rate]
+  float q = config.kalmanProcessNoise;
+  filter.value += filter.rate * dt;
+  filter.p00 += dt * (2.0 * filter.p01 + dt * filter.p11) + q * dt * dt * dt / 3.0;
+  filter.p01 += dt * filter.p11 + q * dt * dt / 2.0;
+  filter.p11 += q * dt;
+
+  float innovation = measurement - filter.value;
+  float s = filter.p00 + config.kalmanMeasurementNoise;
+  float k0 = filter.p00 / s;
+  float k1 = filter.p01 / s;
+
+  filter.value += k0 * innovation;
+  filter.rate += k1 * innovation;
+  filter.p11 -= k1 * filter.p01;
+  filter.p00 -= k0 * filter.p00;
+  filter.p01 -= k0 * filter.p01;
+
+  return filter.value;
+}
+
+void readTemperatures() {
+  if (TESTING_MODE) {
+    // Testing mode - use potentiometer to simulate temperatures
+    int potReading = analogRead(POTENTIOMETER_PIN);
+    float baseTemp = map(potReading, 0, 4095, -10, 30); // Map to -10°C to 30°C range
+
+    // Simulate different temperatures for each zone
+    state.leftTempRaw = baseTemp + random(-20, 20) / 10.0; // Add some variation
+    state.rightTempRaw = baseTemp + random(-20, 20) / 10.0;
+
+    // Add some realistic simulation behavior
+    if (state.compressorOn) {
+      // Simulate cooling effect when compressor is running
+      if (state.currentZone == 0) {
+        state.leftTempRaw -= 0.1; // Slight cooling
+      } else {
+        state.rightTempRaw -= 0.1; // Slight cooling
+      }
+    }
+  } else {
+    // Production mode - read actual NTC sensors and screen them for faults
+    unsigned long now = millis();
+    int leftAdc, rightAdc;
+    float leftReading = readNTC(NTC_LEFT_PIN, &leftAdc);
+    float rightReading = readNTC(NTC_RIGHT_PIN, &rightAdc);
+
+    state.leftTempRaw = updateSensorHealth(leftHealth, "Left", leftAdc, leftReading, now);
+    state.rightTempRaw = updateSensorHealth(rightHealth, "Right", rightAdc, rightReading, now);
+  }
+
+  // Filter stage - the control logic only sees the smoothed values
+  state.leftTemp = applyZoneFilter(leftFilter, state.leftTempRaw, millis());
+  state.rightTemp = applyZoneFilter(rightFilter, state.rightTempRaw, millis());
+
+  uint8_t faults = (leftHealth.faulted ? SENSOR_FAULT_LEFT : 0) | (rightHealth.faulted ? SENSOR_FAULT_RIGHT : 0);
+
+  // Accumulate for the next (decimated) log entry
+  if (!isnan(state.leftTemp)) {
+    logAccumulator.leftSum += state.leftTemp;
+    logAccumulator.leftRawSum += state.leftTempRaw;
+    logAccumulator.leftCount++;
+  }
+  if (!isnan(state.rightTemp)) {
+    logAccumulator.rightSum += state.rightTemp;
+    logAccumulator.rightRawSum += state.rightTempRaw;
+    logAccumulator.rightCount++;
+  }
+  logAccumulator.faults |= faults;
+
+  unsigned long statsNow = millis();
+  updateZoneStats(leftStats, state.leftTemp, config.leftSetpoint + config.hysteresis, statsNow);
+  updateZoneStats(rightStats, state.rightTemp, config.rightSetpoint + config.hysteresis, statsNow);
+
+  LOGD(LOG_SENSOR, "Temps - Left: %.2f°C (raw %.2f), Right: %.2f°C (raw %.2f)%s%s%s",
+    state.leftTemp, state.leftTempRaw, state.rightTemp, state.rightTempRaw,
+    TESTING_MODE ? " [TESTING MODE]" : "",
+    state.manualMode ? " [MANUAL MODE]" : "",
+    faults ? " [SENSOR FAULT]" : "");
+}
+
+void clearStatsBucket(StatsBucket& b) {
+  b = {0, 0.0f, 0.0f, INFINITY, -INFINITY, 0, 0};
+}
+
+// Rebuild the window totals from its buckets (once per bucket period)
+void recomputeWindowTotals(RollingWindow& w) {
+  w.count = 0;
+  w.sum = 0.0;
+  w.sumSq = 0.0;
+  w.sampledMs = 0;
+  w.aboveMs = 0;
+  float lo = INFINITY, hi = -INFINITY;
+  for (int i = 0; i < STATS_BUCKETS; i++) {
+    const StatsBucket& b = w.buckets[i];
+    w.count += b.count;
+    w.sum += b.sum;
+    w.sumSq += b.sumSq;
+    w.sampledMs += b.sampledMs;
+    w.aboveMs += b.aboveMs;
+    lo = min(lo, b.min);
+    hi = max(hi, b.max);
+  }
+  w.min = w.count ? lo : NAN;
+  w.max = w.count ? hi : NAN;
+}
+
+// Move the window's current bucket forward to cover now, expiring the buckets that fall out
+void advanceWindow(RollingWindow& w, uint32_t bucketMs, unsigned long now) {
+  if (now - w.bucketStart < bucketMs) return;
+
+  uint32_t steps = (now - w.bucketStart) / bucketMs;
+  if (steps >= STATS_BUCKETS) {
+    for (int i = 0; i < STATS_BUCKETS; i++) clearStatsBucket(w.buckets[i]);
+    w.bucketStart = now;
+  } else {
+    for (uint32_t i = 0; i < steps; i++) {
+      w.current = (w.current + 1) % STATS_BUCKETS;
+      clearStatsBucket(w.buckets[w.current]);
+    }
+    w.bucketStart += steps * bucketMs;
+  }
+  recomputeWindowTotals(w);
+}
+
+void updateZoneStats(ZoneStats& stats, float temp, float threshold, unsigned long now) {
+  if (!stats.started) {
+    if (isnan(temp)) return;
+    for (int i = 0; i < STATS_WINDOW_COUNT; i++) {
+      RollingWindow& w = stats.windows[i];
+      for (int b = 0; b < STATS_BUCKETS; b++) clearStatsBucket(w.buckets[b]);
+      w.bucketStart = now;
+    }
+    stats.reference = temp;
+    stats.lastSample = now;
+    stats.started = true;
+  }
+
+  uint32_t dt = now - stats.lastSample;
+  if (dt > STATS_MAX_SAMPLE_GAP_MS) dt = 0;
+  stats.lastSample = now;
+
+  for (int i = 0; i < STATS_WINDOW_COUNT; i++) {
+    RollingWindow& w = stats.windows[i];
+    advanceWindow(w, STATS_WINDOW_SEC[i] * 1000UL / STATS_BUCKETS, now);
+    if (isnan(temp)) continue;  // Faulted sensor: the gap shows up as reduced coverage
+
+    float x = temp - stats.reference;
+    bool above = temp > threshold;
+    StatsBucket& b = w.buckets[w.current];
+    b.count++;
+    b.sum += x;
+    b.sumSq += x * x;
+    b.min = min(b.min, temp);
+    b.max = max(b.max, temp);
+    b.sampledMs += dt;
+    if (above) b.aboveMs += dt;
+
+    w.count++;
+    w.sum += x;
+    w.sumSq += (double)x * x;
+    w.min = isnan(w.min) ? temp : min(w.min, temp);
+    w.max = isnan(w.max) ? temp : max(w.max, temp);
+    w.sampledMs += dt;
+    if (above) w.aboveMs += dt;
+  }
+}
+
+void addZoneStatsJSON(JsonObject zone, const ZoneStats& stats) {
+  for (int i = 0; i < STATS_WINDOW_COUNT; i++) {
+    const RollingWindow& w = stats.windows[i];
+    JsonObject out = zone.createNestedObject(STATS_WINDOW_NAMES[i]);
+    out["samples"] = w.count;
+    out["coverageSeconds"] = w.sampledMs / 1000;
+    if (w.count == 0) {
+      out["mean"] = nullptr;
+      continue;
+    }
+    double mean = w.sum / w.count;
+    double variance = w.count > 1 ? max(0.0, (w.sumSq - w.sum * mean) / (w.count - 1)) : 0.0;
+    out["min"] = w.min;
+    out["max"] = w.max;
+    out["mean"] = stats.reference + mean;
+    out["variance"] = variance;
+    out["stddev"] = sqrt(variance);
+    out["aboveSeconds"] = w.aboveMs / 1000;
+    out["abovePercent"] = w.sampledMs ? 100.0 * w.aboveMs / w.sampledMs : 0.0;
+  }
+}
+
+String getStatsJSON() {
+  DynamicJsonDocument doc(2048);
+  addZoneStatsJSON(doc.createNestedObject("left"), leftStats);
+  addZoneStatsJSON(doc.createNestedObject("right"), rightStats);
+  doc["uptime"] = millis() / 1000;
+  String output;
+  serializeJson(doc, output);
+  return output;
+}
+
+int16_t toCentiDegrees(float value) {
+  if (isnan(value) || isinf(value)) return LOG_NO_VALUE;
+  return (int16_t)constrain(lroundf(value * 100.0f), -32767L, 32767L);
+}
+
+float fromCentiDegrees(int16_t value) {
+  return value == LOG_NO_VALUE ? NAN : value / 100.0f;
+}
+
+// Setpoints that applied at a timestamp: the newest event at or before it.
+// The ring holds at most SETPOINT_EVENT_CAPACITY events, so a backwards scan is cheap
+// and stays correct across the pre-NTP timestamps of an earlier boot.
+bool setpointsAt(uint32_t timestamp, float& left, float& right) {
+  const SetpointEventLog& log = setpointEvents;
+  for (int i = 1; i <= log.count; i++) {
+    const SetpointEvent& e = log.events[(log.head + SETPOINT_EVENT_CAPACITY - i) % SETPOINT_EVENT_CAPACITY];
+    if (e.timestamp <= timestamp || i == log.count) {
+      // Entries older than every retained event get the oldest setpoints known
+      left = fromCentiDegrees(e.left);
+      right = fromCentiDegrees(e.right);
+      return true;
+    }
+  }
+  left = config.leftSetpoint;
+  right = config.rightSetpoint;
+  return false;
+}
+
+void saveSetpointEvents() {
+  File file = LittleFS.open(SETPOINT_EVENTS_PATH, "w");
+  if (!file) return;
+  const SetpointEventLog& log = setpointEvents;
+  int first = (log.head + SETPOINT_EVENT_CAPACITY - log.count) % SETPOINT_EVENT_CAPACITY;
+  for (int i = 0; i < log.count; i++) {
+    file.write((const uint8_t*)&log.events[(first + i) % SETPOINT_EVENT_CAPACITY], sizeof(SetpointEvent));
+  }
+  file.close();
+  setpointEvents.persisted = log.count;
+}
+
+// Record a change event when the logged setpoints differ from the newest event
+void recordSetpointEvent(uint32_t timestamp, float left, float right) {
+  SetpointEventLog& log = setpointEvents;
+  SetpointEvent event = {timestamp, toCentiDegrees(left), toCentiDegrees(right)};
+  if (log.count > 0) {
+    const SetpointEvent& last = log.events[(log.head + SETPOINT_EVENT_CAPACITY - 1) % SETPOINT_EVENT_CAPACITY];
+    if (last.left == event.left && last.right == event.right) return;
+  }
+
+  log.events[log.head] = event;
+  log.head = (log.head + 1) % SETPOINT_EVENT_CAPACITY;
+  if (log.count < SETPOINT_EVENT_CAPACITY) log.count++;
+
+  if (!history.ready) return;
+  if (log.persisted >= SETPOINT_EVENT_CAPACITY * 4) {
+    saveSetpointEvents();
+    return;
+  }
+  File file = LittleFS.open(SETPOINT_EVENTS_PATH, "a");
+  if (file) {
+    file.write((const uint8_t*)&event, sizeof(event));
+    file.close();
+    log.persisted++;
+  }
+}
+
+void loadSetpointEvents() {
+  File file = LittleFS.open(SETPOINT_EVENTS_PATH, "r");
+  if (!file) return;
+  uint32_t total = file.size() / sizeof(SetpointEvent);
+  uint32_t skip = total > SETPOINT_EVENT_CAPACITY ? total - SETPOINT_EVENT_CAPACITY : 0;
+  file.seek(skip * sizeof(SetpointEvent), SeekSet);
+  SetpointEventLog& log = setpointEvents;
+  SetpointEvent event;
+  while (file.read((uint8_t*)&event, sizeof(event)) == sizeof(event)) {
+    log.events[log.head] = event;
+    log.head = (log.head + 1) % SETPOINT_EVENT_CAPACITY;
+    if (log.count < SETPOINT_EVENT_CAPACITY) log.count++;
+  }
+  file.close();
+  log.persisted = total;
+}
+
+int8_t packRawDelta(float raw, float filtered) {
+  if (isnan(raw)) return LOG_RAW_NO_VALUE;
+  return (int8_t)constrain(lroundf((raw - filtered) / LOG_RAW_STEP), (long)INT8_MIN + 1, (long)INT8_MAX - 1);
+}
+
+void packZone(float filtered, float raw, int16_t& temp, int8_t& rawDelta) {
+  if (isnan(filtered) && !isnan(raw)) {
+    temp = toCentiDegrees(raw);
+    rawDelta = LOG_RAW_ONLY;
+  } else {
+    temp = toCentiDegrees(filtered);
+    rawDelta = isnan(filtered) ? LOG_RAW_NO_VALUE : packRawDelta(raw, filtered);
+  }
+}
+
+void unpackZone(int16_t temp, int8_t rawDelta, float& filtered, float& raw) {
+  if (rawDelta == LOG_RAW_ONLY) {
+    filtered = NAN;
+    raw = fromCentiDegrees(temp);
+    return;
+  }
+  filtered = fromCentiDegrees(temp);
+  raw = rawDelta == LOG_RAW_NO_VALUE || isnan(filtered) ? NAN : filtered + rawDelta * LOG_RAW_STEP;
+}
+
+// Allocate the RAM log: from PSRAM when the board has it, sized for PSRAM_LOG_SECONDS at the
+// configured log interval, otherwise MAX_LOG_ENTRIES from internal RAM. Records are appended
+// and read sequentially, so PSRAM is mostly accessed in whole cache lines.
+#ifdef LOG_BUFFER_BENCHMARK
+// Time the buffer once so PSRAM cost can be compared against the control tick. Touches
+// every record (seconds for a large PSRAM log), so it's a development build option only.
+void benchmarkTempLog() {
+  unsigned long start = micros();
+  memset(tempLog, 0, logCapacity * sizeof(PackedLogRecord));
+  logTiming.fillUs = micros() - start;
+
+  volatile uint32_t checksum = 0;  // Keeps the reads from being optimised away
+  start = micros();
+  for (int i = 0; i < logCapacity; i++) checksum += tempLog[i].timeFaults;
+  logTiming.scanUs = micros() - start;
+
+  uint32_t index = 12345;
+  start = micros();
+  for (int i = 0; i < 1000; i++) {
+    index = index * 1103515245UL + 12345UL;
+    checksum += tempLog[index % logCapacity].timeFaults;
+  }
+  logTiming.randomReadUs = micros() - start;
+
+  LOGI(LOG_SYS, "Temperature log benchmark: fill %lu us, scan %lu us, 1000 random reads %lu us",
+    (unsigned long)logTiming.fillUs, (unsigned long)logTiming.scanUs, (unsigned long)logTiming.randomReadUs);
+}
+#endif
+
+void initTempLog() {
+  if (psramFound()) {
+    size_t wanted = PSRAM_LOG_SECONDS * 1000UL / max(config.logIntervalMs, (uint32_t)100);
+    size_t budget = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) / PSRAM_LOG_SHARE / sizeof(PackedLogRecord);
+    size_t entries = min(wanted, budget);
+    if (entries > MAX_LOG_ENTRIES) {
+      tempLog = (PackedLogRecord*)heap_caps_malloc(entries * sizeof(PackedLogRecord), MALLOC_CAP_SPIRAM);
+      if (tempLog) {
+        logCapacity = entries;
+        logInPsram = true;
+      }
+    }
+  }
+  if (!tempLog) {
+    tempLog = (PackedLogRecord*)heap_caps_malloc(MAX_LOG_ENTRIES * sizeof(PackedLogRecord), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    logCapacity = tempLog ? MAX_LOG_ENTRIES : 0;
+  }
+  if (!tempLog) {
+    LOGE(LOG_SYS, "No memory for the temperature log");
+    return;
+  }
+
+  LOGI(LOG_SYS, "Temperature log: %d entries (%u KB) in %s",
+    logCapacity, (unsigned)(logCapacity * sizeof(PackedLogRecord) / 1024), logInPsram ? "PSRAM" : "internal RAM");
+#ifdef LOG_BUFFER_BENCHMARK
+  benchmarkTempLog();
+#endif
+}
+
+// Move logTimeBase so the new timestamp fits in 24 bits. Normally this shifts every record
+// by the oldest offset (once every few months); if time jumped backwards or too far forward
+// (e.g. the clock switched epochs) the buffer is restarted.
+void rebaseTempLog(uint32_t timestamp) {
+  int first = (logHead + logCapacity - logCount) % logCapacity;
+  uint32_t shift = logCount ? (tempLog[first].timeFaults & LOG_REL_TIME_MAX) : 0;
+  if (logCount == 0 || timestamp < logTimeBase || timestamp - (logTimeBase + shift) > LOG_REL_TIME_MAX) {
+    if (logCount > 0) LOGW(LOG_SYS, "Log timestamps jumped - restarting RAM log (%d entries dropped)", logCount);
+    logHead = 0;
+    logCount = 0;
+    logTimeBase = timestamp;
+    return;
+  }
+  for (int i = 0; i < logCount; i++) {
+    PackedLogRecord& r = tempLog[(first + i) % logCapacity];
+    uint32_t offset = r.timeFaults & LOG_REL_TIME_MAX;
+    r.timeFaults = (r.timeFaults & ~LOG_REL_TIME_MAX) | (offset > shift ? offset - shift : 0);
+  }
+  logTimeBase += shift;
+}
+
+void appendLogEntry(const TemperatureLogEntry& entry) {
+  if (logCapacity == 0) return;
+  uint32_t timestamp = entry.timestamp;
+  if (logCount == 0 || timestamp < logTimeBase || timestamp - logTimeBase > LOG_REL_TIME_MAX) {
+    rebaseTempLog(timestamp);
+  }
+
+  PackedLogRecord r;
+  int16_t temp;
+  int8_t rawDelta;
+  r.timeFaults = (timestamp - logTimeBase) | ((uint32_t)entry.faults << 24);
+  packZone(entry.leftTemp, entry.leftRaw, temp, rawDelta);
+  r.leftTemp = temp;
+  r.leftRawDelta = rawDelta;
+  packZone(entry.rightTemp, entry.rightRaw, temp, rawDelta);
+  r.rightTemp = temp;
+  r.rightRawDelta = rawDelta;
+  tempLog[logHead] = r;
+
+  logHead = (logHead + 1) % logCapacity;
+  if (logCount < logCapacity) {
+    logCount++;
+  }
+}
+
+// Decode the record at a storage index, merging in the setpoints from the event stream
+TemperatureLogEntry readLogEntry(int index) {
+  const PackedLogRecord& r = tempLog[index];
+  TemperatureLogEntry entry;
+  entry.timestamp = logTimeBase + (r.timeFaults & LOG_REL_TIME_MAX);
+  entry.faults = r.timeFaults >> 24;
+  unpackZone(r.leftTemp, r.leftRawDelta, entry.leftTemp, entry.leftRaw);
+  unpackZone(r.rightTemp, r.rightRawDelta, entry.rightTemp, entry.rightRaw);
+  setpointsAt(entry.timestamp, entry.setpointLeft, entry.setpointRight);
+  return entry;
+}
+
+// Chronological view of the ring: position 0 is the oldest entry, logCount - 1 the newest
+int logStorageIndex(int position) {
+  return (logHead - logCount + position + logCapacity) % logCapacity;
+}
+
+uint32_t logTimestampAt(int position) {
+  return logTimeBase + (tempLog[logStorageIndex(position)].timeFaults & LOG_REL_TIME_MAX);
+}
+
+// First position whose timestamp is >= timestamp (logCount if none)
+int logLowerBound(uint32_t timestamp) {
+  int lo = 0, hi = logCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (logTimestampAt(mid) < timestamp) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+// First position whose timestamp is > timestamp (logCount if none)
+int logUpperBound(uint32_t timestamp) {
+  int lo = 0, hi = logCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (logTimestampAt(mid) <= timestamp) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+// Unix time once NTP has synced; before that, provisional time continuing from the last persisted entry
+uint32_t logTimestamp(bool& synced) {
+  time_t now = time(nullptr);
+  synced = now >= (time_t)TIME_VALID_AFTER;
+  return synced ? (uint32_t)now : timeBase.bootStart + millis() / 1000;
+}
+
+// Write one history entry holding the mean of all samples since the previous one
+void recordTemperatureLog() {
+  const LogAccumulator& acc = logAccumulator;
+  float leftTemp = acc.leftCount ? acc.leftSum / acc.leftCount : NAN;
+  float rightTemp = acc.rightCount ? acc.rightSum / acc.rightCount : NAN;
+  float leftRaw = acc.leftCount ? acc.leftRawSum / acc.leftCount : NAN;
+  float rightRaw = acc.rightCount ? acc.rightRawSum / acc.rightCount : NAN;
+
+  // Log temperature data for charts
+  bool synced;
+  uint32_t currentTimestamp = logTimestamp(synced);
+
+  TemperatureLogEntry entry = {currentTimestamp, leftTemp, rightTemp, config.leftSetpoint, config.rightSetpoint,
+                               leftRaw, rightRaw, (uint8_t)(acc.faults | (synced ? 0 : LOG_FLAG_UNSYNCED))};
+
+  // Store in circular buffer
+  recordSetpointEvent(currentTimestamp, config.leftSetpoint, config.rightSetpoint);
+  unsigned long appendStart = micros();
+  appendLogEntry(entry);
+  uint32_t appendUs = micros() - appendStart;
+  logTiming.appends++;
+  logTiming.appendUsTotal += appendUs;
+  logTiming.appendUsMax = max(logTiming.appendUsMax, appendUs);
+
+  historyAppend(entry);
+  historyTiersAppend(entry);
+
+  logAccumulator = LogAccumulator();
+}
+
+const char* controlEventTypeName(uint8_t type) {
+  switch (type) {
+    case EVT_BOOT: return "boot";
+    case EVT_COMPRESSOR_START: return "compressor_start";
+    case EVT_COMPRESSOR_STOP: return "compressor_stop";
+    case EVT_ZONE_SWITCH: return "zone_switch";
+    case EVT_MAX_RUN_CUTOFF: return "max_run_cutoff";
+    case EVT_MANUAL: return "manual";
+    case EVT_SYSTEM: return "system";
+    case EVT_SENSOR_FAULT: return "sensor_fault";
+    case EVT_SENSOR_RECOVERED: return "sensor_recovered";
+    case EVT_TIME_SYNC: return "time_sync";
+    case EVT_FIRMWARE: return "firmware";
+    default: return "unknown";
+  }
+}
+
+const char* controlEventDetailName(const ControlEvent& event) {
+  static const char* STOP_NAMES[] = {"other", "satisfied", "max_run", "disabled"};
+  static const char* MANUAL_NAMES[] = {"compressor_on", "compressor_off", "solenoid_left", "solenoid_right", "auto"};
+  switch (event.type) {
+    case EVT_COMPRESSOR_STOP: return event.detail <= STOP_DISABLED ? STOP_NAMES[event.detail] : "other";
+    case EVT_MANUAL: return event.detail <= MANUAL_AUTO ? MANUAL_NAMES[event.detail] : "unknown";
+    case EVT_SYSTEM: return event.detail ? "enabled" : "disabled";
+    case EVT_SENSOR_FAULT: return sensorFaultName((SensorFault)event.detail);
+    case EVT_FIRMWARE: return event.detail == FIRMWARE_VALIDATED ? "validated" : "rolled_back";
+    default: return nullptr;
+  }
+}
+
+ControlEvent& controlEventAt(int position) {
+  // position 0 is the oldest retained event
+  return controlEvents.events[(controlEvents.head - controlEvents.count + position + CONTROL_EVENT_CAPACITY) % CONTROL_EVENT_CAPACITY];
+}
+
+void saveControlEvents() {
+  File file = LittleFS.open(CONTROL_EVENTS_PATH, "w");
+  if (!file) return;
+  bool ok = true;
+  for (int i = 0; i < controlEvents.count; i++) {
+    ok = file.write((const uint8_t*)&controlEventAt(i), sizeof(ControlEvent)) == sizeof(ControlEvent) && ok;
+  }
+  file.close();
+  if (!ok) return;  // pending stays set, so the next flush rewrites the file again
+  controlEvents.persisted = controlEvents.count;
+  controlEvents.pending = 0;
+}
+
+// Append events recorded since the last flush. Runs from loop() (and before a restart),
+// never from the control path, so relays don't wait on flash.
+void flushControlEvents() {
+  ControlEventLog& log = controlEvents;
+  if (!history.ready || log.pending == 0) return;
+  if (log.persisted >= CONTROL_EVENT_CAPACITY * 4) {
+    saveControlEvents();
+    return;
+  }
+
+  File file = LittleFS.open(CONTROL_EVENTS_PATH, "a");
+  if (!file) return;  // Retried on the next pass
+  size_t bytes = 0;
+  for (int i = log.count - log.pending; i < log.count; i++) {
+    bytes += file.write((const uint8_t*)&controlEventAt(i), sizeof(ControlEvent));
+  }
+  file.close();
+  if (bytes == log.pending * sizeof(ControlEvent)) {
+    log.persisted += log.pending;
+    log.pending = 0;
+  } else {
+    saveControlEvents();  // A short write leaves a partial record; rewrite the file whole
+  }
+}
+
+void recordControlEvent(uint8_t type, uint8_t zone, uint8_t detail) {
+  bool synced;
+  ControlEvent event;
+  event.seq = controlEvents.nextSeq++;
+  event.timestamp = logTimestamp(synced);
+  event.type = type;
+  event.zone = zone;
+  event.detail = detail;
+  event.flags = synced ? 0 : LOG_FLAG_UNSYNCED;
+  event.leftTemp = toCentiDegrees(state.leftTemp);
+  event.rightTemp = toCentiDegrees(state.rightTemp);
+
+  ControlEventLog& log = controlEvents;
+  log.events[log.head] = event;
+  log.head = (log.head + 1) % CONTROL_EVENT_CAPACITY;
+  if (log.count < CONTROL_EVENT_CAPACITY) log.count++;
+  if (log.pending < log.count) log.pending++;  // Older unsaved events were overwritten in the ring
+}
+
+void loadControlEvents() {
+  File file = LittleFS.open(CONTROL_EVENTS_PATH, "r");
+  if (!file) return;
+  uint32_t total = file.size() / sizeof(ControlEvent);
+  uint32_t skip = total > CONTROL_EVENT_CAPACITY ? total - CONTROL_EVENT_CAPACITY : 0;
+  file.seek(skip * sizeof(ControlEvent), SeekSet);
+  ControlEventLog& log = controlEvents;
+  ControlEvent event;
+  while (file.read((uint8_t*)&event, sizeof(event)) == sizeof(event)) {
+    log.events[log.head] = event;
+    log.head = (log.head + 1) % CONTROL_EVENT_CAPACITY;
+    if (log.count < CONTROL_EVENT_CAPACITY) log.count++;
+    log.nextSeq = max(log.nextSeq, event.seq + 1);
+  }
+  file.close();
+  log.persisted = total;
+  log.pending = 0;
+}
+
+// One page of events as JSON, newest first. before=0 starts at the newest event;
+// "next" is the before value for the following (older) page, 0 when there are no more.
+String getControlEventsJSON(uint32_t before, int limit) {
+  DynamicJsonDocument doc(512 + limit * 224);
+  doc["total"] = controlEvents.count;
+  JsonArray events = doc.createNestedArray("events");
+
+  // Sequence numbers increase along the ring but may have gaps (events lost to a failed
+  // write before a reboot), so the start is found by binary search
+  int position = controlEvents.count - 1;
+  if (before > 0) {
+    int lo = 0, hi = controlEvents.count;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (controlEventAt(mid).seq < before) lo = mid + 1; else hi = mid;
+    }
+    position = lo - 1;  // Newest event older than before
+  }
+
+  int added = 0;
+  for (; position >= 0 && added < limit; position--, added++) {
+    const ControlEvent& e = controlEventAt(position);
+    JsonObject item = events.createNestedObject();
+    item["seq"] = e.seq;
+    item["timestamp"] = e.timestamp;
+    if (e.flags & LOG_FLAG_UNSYNCED) item["unsynced"] = true;
+    item["type"] = controlEventTypeName(e.type);
+    if (e.zone != EVENT_ZONE_NONE) item["zone"] = e.zone == 0 ? "left" : "right";
+    const char* detail = controlEventDetailName(e);
+    if (detail) item["detail"] = detail;
+    if (e.leftTemp == LOG_NO_VALUE) item["leftTemp"] = nullptr; else item["leftTemp"] = fromCentiDegrees(e.leftTemp);
+    if (e.rightTemp == LOG_NO_VALUE) item["rightTemp"] = nullptr; else item["rightTemp"] = fromCentiDegrees(e.rightTemp);
+  }
+  doc["next"] = position >= 0 ? controlEventAt(position + 1).seq : 0;
+
+  String output;
+  serializeJson(doc, output);
+  return output;
+}
+
+String historySegmentPath(uint32_t segmentId) {
+  char path[32];
+  snprintf(path, sizeof(path), HIST_DIR "/s%08lx.bin", (unsigned long)segmentId);
+  return String(path);
+}
+
+bool saveHistoryIndex() {
+  return writeHistoryIndex(LittleFS, history.segments, history.segmentCount);
+}
+
+// ---- History block codec (see history_codec.h) ----
+HistorySample sampleFromEntry(const TemperatureLogEntry& entry) {
+  HistorySample s;
+  s.timestamp = entry.timestamp;
+  s.faults = entry.faults;
+  packZone(entry.leftTemp, entry.leftRaw, s.leftTemp, s.leftRawDelta);
+  packZone(entry.rightTemp, entry.rightRaw, s.rightTemp, s.rightRawDelta);
+  return s;
+}
+
+// Timestamp of a stored sample, with any NTP correction recorded after it was flushed
+uint32_t sampleTimestamp(const HistorySample& s) {
+  return (s.faults & LOG_FLAG_UNSYNCED) ? correctedTimestamp(s.timestamp) : s.timestamp;
+}
+
+TemperatureLogEntry entryFromSample(const HistorySample& s) {
+  TemperatureLogEntry entry;
+  entry.timestamp = sampleTimestamp(s);
+  entry.faults = s.faults;
+  if (entry.timestamp != s.timestamp) entry.faults &= ~LOG_FLAG_UNSYNCED;
+  unpackZone(s.leftTemp, s.leftRawDelta, entry.leftTemp, entry.leftRaw);
+  unpackZone(s.rightTemp, s.rightRawDelta, entry.rightTemp, entry.rightRaw);
+  setpointsAt(entry.timestamp, entry.setpointLeft, entry.setpointRight);
+  return entry;
+}
+
+// The newest segment is appended without rewriting the index, so its count and
+// last timestamp are recovered from the file's block headers at boot
+void refreshTailSegment() {
+  if (history.segmentCount == 0) return;
+  HistoryIndexEntry& tail = history.segments[history.segmentCount - 1];
+
+  File file = LittleFS.open(historySegmentPath(tail.segmentId), "r");
+  HistorySegmentHeader header;
+  if (!file || !readSegmentHeader(file, header)) {
+    if (file) file.close();
+    LOGW(LOG_SYS, "History segment %08lx unreadable - dropping it", (unsigned long)tail.segmentId);
+    LittleFS.remove(historySegmentPath(tail.segmentId));
+    history.segmentCount--;
+    saveHistoryIndex();
+    return;
+  }
+
+  // Appending after a torn block would hide everything written later
+  if (!scanHistorySegment(file, tail)) history.tailTorn = true;
+  file.close();
+}
+
+bool startHistorySegment(uint32_t firstTimestamp) {
+  // Keep total size bounded: drop the oldest segment before adding a new one
+  if (history.segmentCount == HIST_MAX_SEGMENTS) {
+    LittleFS.remove(historySegmentPath(history.segments[0].segmentId));
+    memmove(&history.segments[0], &history.segments[1], sizeof(HistoryIndexEntry) * (HIST_MAX_SEGMENTS - 1));
+    history.segmentCount--;
+  }
+
+  uint32_t segmentId = history.nextSegmentId;
+  File file = LittleFS.open(historySegmentPath(segmentId), "w");
+  if (!file) return false;
+  bool ok = writeSegmentHeader(file, segmentId, firstTimestamp);
+  file.close();
+  if (!ok) return false;
+
+  history.segments[history.segmentCount++] = {segmentId, firstTimestamp, firstTimestamp, 0};
+  history.nextSegmentId++;
+  history.tailTorn = false;
+  return saveHistoryIndex();
+}
+
+// Move staged entries to flash as compressed blocks, rotating segments as they fill
+void flushHistory() {
+  if (!history.ready || history.stageCount == 0) return;
+
+  static HistorySample samples[HIST_STAGE_ENTRIES];
+  int written = 0;
+  while (written < history.stageCount) {
+    // While a reader (e.g. an export) walks the segments, the tail grows past its nominal size
+    // instead of rotating, so no segment is deleted or renumbered underneath it
+    bool tailFull = history.segmentCount > 0 &&
+                    history.segments[history.segmentCount - 1].count >= HIST_SEGMENT_RECORDS;
+    if (history.segmentCount == 0 || history.tailTorn || (tailFull && history.readers == 0)) {
+      // A torn tail can't be appended to. If replacing it would evict segments[0] under a
+      // reader, keep the entries staged until the reader is done (historyForEach flushes then);
+      // only a full stage is given up, like any other failed flush.
+      if (history.readers > 0 && history.segmentCount == HIST_MAX_SEGMENTS) {
+        if (history.stageCount < HIST_STAGE_ENTRIES) {
+          memmove(&history.stage[0], &history.stage[written], sizeof(TemperatureLogEntry) * (history.stageCount - written));
+          history.stageCount -= written;
+          return;
+        }
+        break;
+      }
+      if (!startHistorySegment(history.stage[written].timestamp)) break;
+    }
+
+    HistoryIndexEntry& tail = history.segments[history.segmentCount - 1];
+    int batch = tail.count >= HIST_SEGMENT_RECORDS ? history.stageCount - written
+                                                   : min((int)(HIST_SEGMENT_RECORDS - tail.count), history.stageCount - written);
+    for (int i = 0; i < batch; i++) samples[i] = sampleFromEntry(history.stage[written + i]);
+
+    File file = LittleFS.open(historySegmentPath(tail.segmentId), "a");
+    if (!file) break;
+    HistoryBlockHeader block;
+    bool ok = appendHistoryBlock(file, samples, batch, historyBlockBuffer, block);
+    file.close();
+    if (!ok) {
+      history.tailTorn = true;
+      break;
+    }
+
+    if (tail.count == 0) tail.firstTimestamp = block.firstTimestamp;
+    tail.count += batch;
+    tail.lastTimestamp = block.lastTimestamp;
+    history.entriesWritten += batch;
+    history.bytesWritten += sizeof(block) + block.length;
+    written += batch;
+  }
+
+  if (written < history.stageCount) {
+    history.writeErrors++;
+    LOGE(LOG_SYS, "History flush failed after %d of %d entries", written, history.stageCount);
+  }
+
+  history.stageCount = 0;  // Never let a failing flash stall logging
+  history.lastFlush = millis();
+  history.flushes++;
+}
+
+void historyAppend(const TemperatureLogEntry& entry) {
+  if (!history.ready) return;
+  history.stage[history.stageCount++] = entry;
+  if (history.stageCount == HIST_STAGE_ENTRIES) {
+    flushHistory();
+  }
+}
+
+// Called from loop(): flush a partially filled stage so a power cut loses at most a minute
+void serviceHistory() {
+  if (history.ready && history.stageCount > 0 && millis() - history.lastFlush > HIST_FLUSH_INTERVAL_MS) {
+    flushHistory();
+  }
+  flushControlEvents();
+}
+
+// Visit persisted and staged entries with fromTs <= timestamp <= toTs in storage order.
+// Segments are located through the index; within a segment, blocks outside the range are
+// skipped by their headers and only overlapping blocks are decoded.
+// Returns the number of entries visited; fn returns false to stop early.
+uint32_t historyForEach(uint32_t fromTs, uint32_t toTs, std::function<bool(const TemperatureLogEntry&)> fn) {
+  uint32_t visited = 0;
+  if (!history.ready) return 0;
+  history.readers++;
+
+  // First segment that can contain fromTs
+  int lo = 0, hi = history.segmentCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (correctedTimestamp(history.segments[mid].lastTimestamp) < fromTs) lo = mid + 1; else hi = mid;
+  }
+
+  bool stopped = false;
+  for (int s = lo; s < history.segmentCount && !stopped; s++) {
+    const HistoryIndexEntry& seg = history.segments[s];
+    if (correctedTimestamp(seg.firstTimestamp) > toTs) {
+      stopped = true;
+      break;
+    }
+    if (seg.count == 0) continue;
+
+    File file = LittleFS.open(historySegmentPath(seg.segmentId), "r");
+    HistorySegmentHeader header;
+    if (!file || !readSegmentHeader(file, header)) {
+      if (file) file.close();
+      continue;
+    }
+
+    // Own buffer: fn may run the control loop, which can flush through historyBlockBuffer
+    uint8_t encoded[HIST_BLOCK_MAX_BYTES];
+    HistoryBlockHeader block;
+    while (!stopped && file.position() < file.size() && readBlockHeader(file, block)) {
+      if (correctedTimestamp(block.lastTimestamp) < fromTs) {
+        file.seek(block.length, SeekCur);
+        continue;
+      }
+      if (correctedTimestamp(block.firstTimestamp) > toTs) {
+        stopped = true;
+        break;
+      }
+      if (file.read(encoded, block.length) != block.length) break;
+      decodeHistoryBlock(encoded, block.length, block.firstTimestamp, block.count,
+        [&](const HistorySample& sample) {
+          uint32_t timestamp = sampleTimestamp(sample);
+          if (timestamp < fromTs) return true;
+          if (timestamp > toTs) {
+            stopped = true;
+            return false;
+          }
+          visited++;
+          if (!fn(entryFromSample(sample))) {
+            stopped = true;
+            return false;
+          }
+          return true;
+        });
+    }
+    file.close();
+  }
+  for (int i = 0; !stopped && i < history.stageCount; i++) {
+    const TemperatureLogEntry& entry = history.stage[i];
+    if (entry.timestamp < fromTs) continue;
+    if (entry.timestamp > toTs) break;
+    visited++;
+    if (!fn(entry)) break;
+  }
+  history.readers--;
+  if (history.readers == 0 && history.tailTorn) flushHistory();  // Rotation deferred while reading
+  return visited;
+}
+
+// Reload the newest logCapacity persisted entries so /api/logs survives reboots and OTA
+void restoreTemperatureLog() {
+  uint32_t total = 0;
+  for (int i = 0; i < history.segmentCount; i++) total += history.segments[i].count;
+  if (total == 0 || logCapacity == 0) return;
+
+  // Start from the segment holding the first entry we want
+  uint32_t skip = total > (uint32_t)logCapacity ? total - logCapacity : 0;
+  int s = 0;
+  while (s < history.segmentCount && skip >= history.segments[s].count) {
+    skip -= history.segments[s].count;
+    s++;
+  }
+  if (s == history.segmentCount) return;
+
+  // Block granularity is enough: a few extra old entries just wrap out of the ring
+  uint32_t fromTs = correctedTimestamp(history.segments[s].firstTimestamp);
+  File file = LittleFS.open(historySegmentPath(history.segments[s].segmentId), "r");
+  if (file) {
+    HistorySegmentHeader header;
+    HistoryBlockHeader block;
+    if (readSegmentHeader(file, header)) {
+      while (file.position() < file.size() && readBlockHeader(file, block) && skip >= block.count) {
+        skip -= block.count;
+        fromTs = correctedTimestamp(block.lastTimestamp) + 1;
+        file.seek(block.length, SeekCur);
+      }
+    }
+    file.close();
+  }
+
+  historyForEach(fromTs, UINT32_MAX, [](const TemperatureLogEntry& e) {
+    appendLogEntry(e);
+    return true;
+  });
+
+  LOGI(LOG_SYS, "Restored %d log entries from flash history", logCount);
+}
+
+// Only timestamps inside a recorded provisional range are shifted
+uint32_t correctedTimestamp(uint32_t timestamp) {
+  for (int i = 0; i < timeCorrectionCount; i++) {
+    const TimeCorrection& fix = timeCorrections[i];
+    if (timestamp >= fix.fromTs && timestamp <= fix.toTs) return timestamp + fix.offset;
+  }
+  return timestamp;
+}
+
+void loadTimeCorrections() {
+  File file = LittleFS.open(TIME_FIX_PATH, "r");
+  if (!file) return;
+  timeCorrectionCount = file.read((uint8_t*)timeCorrections, sizeof(timeCorrections)) / sizeof(TimeCorrection);
+  file.close();
+}
+
+void addTimeCorrection(uint32_t fromTs, uint32_t toTs, int32_t offset) {
+  if (timeCorrectionCount == TIME_FIX_CAPACITY) {
+    // The oldest correction covers data that has long since rotated out of flash
+    memmove(&timeCorrections[0], &timeCorrections[1], sizeof(TimeCorrection) * (TIME_FIX_CAPACITY - 1));
+    timeCorrectionCount--;
+  }
+  timeCorrections[timeCorrectionCount++] = {fromTs, toTs, offset};
+
+  File file = LittleFS.open(TIME_FIX_PATH, "w");
+  if (!file) return;
+  file.write((const uint8_t*)timeCorrections, sizeof(TimeCorrection) * timeCorrectionCount);
+  file.close();
+}
+
+// Shift this boot's provisional entries in the RAM ring (its newest flagged entries) by offset.
+// Corrected times are kept monotonic, and if they no longer fit the ring's 24-bit offsets the
+// oldest entries are dropped. Returns the position of the first corrected entry.
+int correctRamLog(uint32_t fromTs, int32_t offset) {
+  int first = logCount;
+  while (first > 0) {
+    uint32_t timeFaults = tempLog[logStorageIndex(first - 1)].timeFaults;
+    if (!((timeFaults >> 24) & LOG_FLAG_UNSYNCED) || logTimestampAt(first - 1) < fromTs) break;
+    first--;
+  }
+  if (first == logCount) return logCount;
+
+  // Pass 1: the newest corrected time decides how many old entries still fit
+  uint32_t floorTs = first > 0 ? logTimestampAt(first - 1) : 0;
+  uint32_t newest = max(logTimestampAt(logCount - 1) + offset, floorTs);
+  int drop = 0;
+  while (drop < first && newest - logTimestampAt(drop) > LOG_REL_TIME_MAX) drop++;
+
+  // Pass 2: rewrite every record relative to the new base
+  uint32_t base = drop < first ? logTimestampAt(drop) : max(logTimestampAt(first) + offset, floorTs);
+  uint32_t previous = base;
+  for (int i = drop; i < logCount; i++) {
+    PackedLogRecord& r = tempLog[logStorageIndex(i)];
+    uint32_t timestamp = logTimeBase + (r.timeFaults & LOG_REL_TIME_MAX);
+    uint32_t flags = r.timeFaults >> 24;
+    if (i >= first) {
+      timestamp = max(timestamp + offset, previous);
+      flags &= ~LOG_FLAG_UNSYNCED;
+    }
+    previous = timestamp;
+    r.timeFaults = (flags << 24) | min(timestamp - base, (uint32_t)LOG_REL_TIME_MAX);
+  }
+  logTimeBase = base;
+  logCount -= drop;
+  if (drop > 0) LOGW(LOG_SYS, "Dropped %d old log entries to fit corrected timestamps", drop);
+  return first - drop;
+}
+
+// Called from loop(): when NTP first syncs, move this boot's provisional timestamps onto the wall clock
+void serviceTimeBase() {
+  if (timeBase.synced) return;
+  time_t now = time(nullptr);
+  if (now < (time_t)TIME_VALID_AFTER) return;
+
+  uint32_t provisionalNow = timeBase.bootStart + millis() / 1000;
+  int32_t offset = (int32_t)((uint32_t)now - provisionalNow);
+  timeBase.synced = true;
+  timeBase.syncOffset = offset;
+  if (offset == 0) return;
+
+  // Entries still staged for flash
+  for (int i = 0; i < history.stageCount; i++) {
+    TemperatureLogEntry& entry = history.stage[i];
+    if ((entry.faults & LOG_FLAG_UNSYNCED) && entry.timestamp >= timeBase.bootStart) {
+      entry.timestamp += offset;
+      entry.faults &= ~LOG_FLAG_UNSYNCED;
+    }
+  }
+
+  // Setpoint changes made before the sync
+  bool setpointsChanged = false;
+  for (int i = 0; i < setpointEvents.count; i++) {
+    SetpointEvent& event = setpointEvents.events[i];
+    if (event.timestamp >= timeBase.bootStart && event.timestamp <= provisionalNow) {
+      event.timestamp += offset;
+      setpointsChanged = true;
+    }
+  }
+  if (setpointsChanged && history.ready) saveSetpointEvents();
+
+  // Control events journaled before the sync
+  bool eventsChanged = false;
+  for (int i = 0; i < controlEvents.count; i++) {
+    ControlEvent& event = controlEventAt(i);
+    if ((event.flags & LOG_FLAG_UNSYNCED) && event.timestamp >= timeBase.bootStart) {
+      event.timestamp += offset;
+      event.flags &= ~LOG_FLAG_UNSYNCED;
+      eventsChanged = true;
+    }
+  }
+  if (eventsChanged && history.ready) saveControlEvents();
+
+  // RAM ring: rewritten in place, then fed to the rollup tiers that skipped them until now
+  int first = correctRamLog(timeBase.bootStart, offset);
+  for (int i = first; i < logCount; i++) {
+    historyTiersAppend(readLogEntry(logStorageIndex(i)));
+  }
+  timeBase.correctedEntries = logCount - first;
+
+  // Blocks already on flash keep their provisional times and are corrected when read
+  if (history.ready && history.segmentCount > 0 &&
+      history.segments[history.segmentCount - 1].lastTimestamp >= timeBase.bootStart) {
+    addTimeCorrection(timeBase.bootStart, provisionalNow, offset);
+  }
+
+  recordControlEvent(EVT_TIME_SYNC, EVENT_ZONE_NONE);
+  LOGI(LOG_SYS, "NTP synced - corrected %lu log entries by %ld s",
+    (unsigned long)timeBase.correctedEntries, (long)offset);
+}
+
+void initHistory() {
+  if (!LittleFS.exists(HIST_DIR)) {
+    LittleFS.mkdir(HIST_DIR);
+  }
+
+  history.segmentCount = readHistoryIndex(LittleFS, history.segments, HIST_MAX_SEGMENTS);
+
+  // Segments written by an incompatible firmware are discarded rather than misread
+  if (history.segmentCount > 0) {
+    File file = LittleFS.open(historySegmentPath(history.segments[0].segmentId), "r");
+    HistorySegmentHeader header;
+    bool compatible = file && readSegmentHeader(file, header);
+    if (file) file.close();
+    if (!compatible) {
+      LOGW(LOG_SYS, "History format changed - clearing %d old segments", history.segmentCount);
+      for (int i = 0; i < history.segmentCount; i++) LittleFS.remove(historySegmentPath(history.segments[i].segmentId));
+      history.segmentCount = 0;
+      saveHistoryIndex();
+    }
+  }
+
+  history.nextSegmentId = history.segmentCount ? history.segments[history.segmentCount - 1].segmentId + 1 : 0;
+  refreshTailSegment();
+  loadSetpointEvents();
+  loadControlEvents();
+  loadTimeCorrections();
+
+  // Provisional timestamps continue from the newest entry already persisted
+  if (history.segmentCount > 0) {
+    timeBase.bootStart = history.segments[history.segmentCount - 1].lastTimestamp;
+  }
+  history.ready = true;
+  history.lastFlush = millis();
+
+  restoreTemperatureLog();
+  initHistoryTiers();
+}
+
+// Create (or recreate after a format change) a tier file with every slot empty
+bool openHistoryTier(HistoryTier& tier) {
+  TierHeader expected = {TIER_MAGIC, TIER_FORMAT_VERSION, sizeof(HistoryAggregate), tier.step, tier.capacity};
+
+  if (LittleFS.exists(tier.path)) {
+    File file = LittleFS.open(tier.path, "r");
+    TierHeader header;
+    bool ok = file && file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              memcmp(&header, &expected, sizeof(header)) == 0 &&
+              file.size() == sizeof(TierHeader) + tier.capacity * sizeof(HistoryAggregate);
+    if (file) file.close();
+    if (ok) return true;
+    LOGW(LOG_SYS, "History tier %s has a different layout - recreating", tier.name);
+  }
+
+  File file = LittleFS.open(tier.path, "w");
+  if (!file) return false;
+  bool ok = file.write((const uint8_t*)&expected, sizeof(expected)) == sizeof(expected);
+  HistoryAggregate empty[HIST_READ_CHUNK];
+  memset(empty, 0, sizeof(empty));
+  for (uint32_t i = 0; ok && i < tier.capacity; i += HIST_READ_CHUNK) {
+    size_t n = min((uint32_t)HIST_READ_CHUNK, tier.capacity - i);
+    ok = file.write((const uint8_t*)empty, n * sizeof(HistoryAggregate)) == n * sizeof(HistoryAggregate);
+  }
+  file.close();
+  return ok;
+}
+
+void initHistoryTiers() {
+  for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+    historyTiers[i].ready = openHistoryTier(historyTiers[i]);
+    if (!historyTiers[i].ready) LOGE(LOG_SYS, "History tier %s unavailable", historyTiers[i].name);
+  }
+}
+
+HistoryAggregate finishAggregate(const AggregateBuilder& b) {
+  HistoryAggregate agg;
+  agg.timestamp = b.bucketStart;
+  agg.leftMin = b.leftCount ? toCentiDegrees(b.leftMin) : TIER_NO_VALUE;
+  agg.leftMax = b.leftCount ? toCentiDegrees(b.leftMax) : TIER_NO_VALUE;
+  agg.leftMean = b.leftCount ? toCentiDegrees(b.leftSum / b.leftCount) : TIER_NO_VALUE;
+  agg.rightMin = b.rightCount ? toCentiDegrees(b.rightMin) : TIER_NO_VALUE;
+  agg.rightMax = b.rightCount ? toCentiDegrees(b.rightMax) : TIER_NO_VALUE;
+  agg.rightMean = b.rightCount ? toCentiDegrees(b.rightSum / b.rightCount) : TIER_NO_VALUE;
+  agg.setpointLeft = toCentiDegrees(b.setpointLeft);
+  agg.setpointRight = toCentiDegrees(b.setpointRight);
+  agg.samples = min(b.samples, (uint32_t)UINT16_MAX);
+  agg.faults = b.faults;
+  agg.reserved = 0;
+  return agg;
+}
+
+void writeTierSlot(HistoryTier& tier, const HistoryAggregate& agg) {
+  if (!tier.ready) return;
+  uint32_t slot = (agg.timestamp / tier.step) % tier.capacity;
+  File file = LittleFS.open(tier.path, "r+");
+  if (!file) return;
+  file.seek(sizeof(TierHeader) + slot * sizeof(HistoryAggregate), SeekSet);
+  file.write((const uint8_t*)&agg, sizeof(agg));
+  file.close();
+}
+
+// Merge one aggregate (a raw entry counts as a single-sample aggregate) into a tier.
+// Closing a bucket writes its slot and feeds it to the next coarser tier.
+void tierAdd(int level, const HistoryAggregate& in) {
+  HistoryTier& tier = historyTiers[level];
+  AggregateBuilder& b = tier.current;
+  uint32_t bucket = in.timestamp - in.timestamp % tier.step;
+
+  if (b.samples > 0 && bucket != b.bucketStart) {
+    HistoryAggregate done = finishAggregate(b);
+    writeTierSlot(tier, done);
+    if (level + 1 < HISTORY_TIER_COUNT) tierAdd(level + 1, done);
+    b = AggregateBuilder();
+  }
+
+  b.bucketStart = bucket;
+  uint32_t weight = max((uint32_t)in.samples, (uint32_t)1);
+  if (in.leftMean != TIER_NO_VALUE) {
+    b.leftSum += fromCentiDegrees(in.leftMean) * weight;
+    b.leftCount += weight;
+    b.leftMin = min(b.leftMin, fromCentiDegrees(in.leftMin));
+    b.leftMax = max(b.leftMax, fromCentiDegrees(in.leftMax));
+  }
+  if (in.rightMean != TIER_NO_VALUE) {
+    b.rightSum += fromCentiDegrees(in.rightMean) * weight;
+    b.rightCount += weight;
+    b.rightMin = min(b.rightMin, fromCentiDegrees(in.rightMin));
+    b.rightMax = max(b.rightMax, fromCentiDegrees(in.rightMax));
+  }
+  b.setpointLeft = fromCentiDegrees(in.setpointLeft);
+  b.setpointRight = fromCentiDegrees(in.setpointRight);
+  b.samples += weight;
+  b.faults |= in.faults;
+}
+
+void historyTiersAppend(const TemperatureLogEntry& entry) {
+  if (entry.faults & LOG_FLAG_UNSYNCED) return;  // Added once NTP syncs (see serviceTimeBase)
+  HistoryAggregate in;
+  in.timestamp = entry.timestamp;
+  in.leftMin = in.leftMax = in.leftMean = toCentiDegrees(entry.leftTemp);
+  in.rightMin = in.rightMax = in.rightMean = toCentiDegrees(entry.rightTemp);
+  in.setpointLeft = toCentiDegrees(entry.setpointLeft);
+  in.setpointRight = toCentiDegrees(entry.setpointRight);
+  in.samples = 1;
+  in.faults = entry.faults;
+  in.reserved = 0;
+  tierAdd(0, in);
+}
+
+// Visit the tier's buckets covering [fromTs, toTs] oldest first, then the in-progress bucket
+void tierForEach(HistoryTier& tier, uint32_t fromTs, uint32_t toTs, std::function<void(const HistoryAggregate&)> fn) {
+  uint32_t firstBucket = fromTs / tier.step;
+  uint32_t lastBucket = toTs / tier.step;
+  if (lastBucket - firstBucket >= tier.capacity) firstBucket = lastBucket - tier.capacity + 1;
+
+  if (tier.ready) {
+    File file = LittleFS.open(tier.path, "r");
+    if (file) {
+      HistoryAggregate chunk[HIST_READ_CHUNK];
+      uint32_t bucket = firstBucket;
+      while (bucket <= lastBucket) {
+        // Read contiguous slots up to the end of the file, then wrap
+        uint32_t slot = bucket % tier.capacity;
+        uint32_t n = min(min((uint32_t)HIST_READ_CHUNK, tier.capacity - slot), lastBucket - bucket + 1);
+        file.seek(sizeof(TierHeader) + slot * sizeof(HistoryAggregate), SeekSet);
+        if (file.read((uint8_t*)chunk, n * sizeof(HistoryAggregate)) != n * sizeof(HistoryAggregate)) break;
+        for (uint32_t i = 0; i < n; i++) {
+          // A slot still holding an older lap (or never written) doesn't belong to this bucket
+          if (chunk[i].timestamp == (bucket + i) * tier.step && chunk[i].samples > 0) fn(chunk[i]);
+        }
+        bucket += n;
+      }
+      file.close();
+    }
+  }
+
+  if (tier.current.samples > 0 && tier.current.bucketStart >= fromTs && tier.current.bucketStart <= toTs) {
+    fn(finishAggregate(tier.current));
+  }
+}
+
+// Buffers small writes into HTTP chunks so large responses never sit in RAM as one String
+struct ChunkedWriter {
+  char buffer[1024];
+  size_t used = 0;
+
+  bool connected() {
+    return server.client().connected();
+  }
+
+  void begin(const char* contentType) {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, contentType, "");
+  }
+
+  void flush() {
+    if (used > 0) server.sendContent(buffer, used);
+    used = 0;
+  }
+
+  void write(const char* data, size_t len) {
+    if (used + len > sizeof(buffer)) flush();
+    if (len > sizeof(buffer)) {
+      server.sendContent(data, len);
+      return;
+    }
+    memcpy(buffer + used, data, len);
+    used += len;
+  }
+
+  void print(const char* text) {
+    write(text, strlen(text));
+  }
+
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0) write(line, min((size_t)len, sizeof(line) - 1));
+  }
+
+  void end() {
+    flush();
+    server.sendContent("");
   }
+};
 
-  Serial.println();
-  return finalTemp;
+// Append a temperature as a JSON number, or null for a missing value
+void writeJsonTemp(char* out, size_t size, float value) {
+  if (isnan(value)) snprintf(out, size, "null");
+  else snprintf(out, size, "%.2f", value);
 }
 
-void readTemperatures() {
-  if (TESTING_MODE) {
-    // Testing mode - use potentiometer to simulate temperatures
-    int potReading = analogRead(POTENTIOMETER_PIN);
-    float baseTemp = map(potReading, 0, 4095, -10, 30); // Map to -10°C to 30°C range
+// Optional trailing JSON members for the fault bits and the provisional-time flag
+void formatLogFlags(char* out, size_t size, uint8_t faults) {
+  int len = 0;
+  out[0] = '\0';
+  uint8_t sensorFaults = faults & ~LOG_FLAG_UNSYNCED;
+  if (sensorFaults) len = snprintf(out, size, ",\"faults\":%u", sensorFaults);
+  if (faults & LOG_FLAG_UNSYNCED) snprintf(out + len, size - len, ",\"unsynced\":true");
+}
 
-    // Simulate different temperatures for each zone
-    state.leftTemp = baseTemp + random(-20, 20) / 10.0; // Add some variation
-    state.rightTemp = baseTemp + random(-20, 20) / 10.0;
+// Stream history for a time range as a JSON array, picking the tier that matches the span:
+// raw entries up to an hour, 1-minute buckets up to a day, 15-minute buckets beyond
+void sendHistoryJSON(uint32_t fromTs, uint32_t toTs, String tierName) {
+  if (tierName.length() == 0) {
+    uint32_t span = toTs - fromTs;
+    tierName = span <= RAW_TIER_SPAN_SEC ? "raw" : span <= MINUTE_TIER_SPAN_SEC ? "1m" : "15m";
+  }
 
-    // Add some realistic simulation behavior
-    if (state.compressorOn) {
-      // Simulate cooling effect when compressor is running
-      if (state.currentZone == 0) {
-        state.leftTemp -= 0.1; // Slight cooling
-      } else {
-        state.rightTemp -= 0.1; // Slight cooling
-      }
-    }
+  ChunkedWriter out;
+  out.begin("application/json");
+  out.printf("{\"tier\":\"%s\",\"from\":%lu,\"to\":%lu,\"entries\":[",
+    tierName.c_str(), (unsigned long)fromTs, (unsigned long)toTs);
+
+  bool first = true;
+  char l[12], r[12], flags[40];
+  if (tierName == "raw") {
+    historyForEach(fromTs, toTs, [&](const TemperatureLogEntry& e) {
+      writeJsonTemp(l, sizeof(l), e.leftTemp);
+      writeJsonTemp(r, sizeof(r), e.rightTemp);
+      formatLogFlags(flags, sizeof(flags), e.faults);
+      out.printf("%s{\"timestamp\":%lu,\"leftTemp\":%s,\"rightTemp\":%s,\"setpointLeft\":%.2f,\"setpointRight\":%.2f%s}",
+        first ? "" : ",", (unsigned long)e.timestamp, l, r, e.setpointLeft, e.setpointRight, flags);
+      first = false;
+      return true;
+    });
   } else {
-    // Production mode - read actual NTC sensors
-    state.leftTemp = readNTC(NTC_LEFT_PIN);
-    state.rightTemp = readNTC(NTC_RIGHT_PIN);
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      if (tierName != historyTiers[i].name) continue;
+      tierForEach(historyTiers[i], fromTs, toTs, [&](const HistoryAggregate& a) {
+        char lmin[12], lmax[12], rmin[12], rmax[12];
+        writeJsonTemp(l, sizeof(l), fromCentiDegrees(a.leftMean));
+        writeJsonTemp(r, sizeof(r), fromCentiDegrees(a.rightMean));
+        writeJsonTemp(lmin, sizeof(lmin), fromCentiDegrees(a.leftMin));
+        writeJsonTemp(lmax, sizeof(lmax), fromCentiDegrees(a.leftMax));
+        writeJsonTemp(rmin, sizeof(rmin), fromCentiDegrees(a.rightMin));
+        writeJsonTemp(rmax, sizeof(rmax), fromCentiDegrees(a.rightMax));
+        out.printf("%s{\"timestamp\":%lu,\"leftTemp\":%s,\"leftMin\":%s,\"leftMax\":%s,"
+                   "\"rightTemp\":%s,\"rightMin\":%s,\"rightMax\":%s,"
+                   "\"setpointLeft\":%.2f,\"setpointRight\":%.2f,\"samples\":%u,\"faults\":%u}",
+          first ? "" : ",", (unsigned long)a.timestamp, l, lmin, lmax, r, rmin, rmax,
+          fromCentiDegrees(a.setpointLeft), fromCentiDegrees(a.setpointRight), a.samples, a.faults);
+        first = false;
+      });
+    }
   }
 
-  // Log temperature data for charts
-  unsigned long currentTimestamp = time(nullptr); // Use Unix timestamp
-  if (currentTimestamp < 1609459200) { // Jan 1, 2021 - fallback to millis-based timestamp
-    currentTimestamp = millis() / 1000;
+  out.print("]}");
+  out.end();
+}
+
+// Stream persisted history for a range as CSV or NDJSON straight from flash. Memory use is
+// one decoded block plus the chunk buffer; the control loop keeps running between chunks.
+void sendHistoryExport(uint32_t fromTs, uint32_t toTs, bool csv) {
+  char filename[64];
+  snprintf(filename, sizeof(filename), "attachment; filename=\"fridge-%lu-%lu.%s\"",
+    (unsigned long)fromTs, (unsigned long)toTs, csv ? "csv" : "ndjson");
+  server.sendHeader("Content-Disposition", filename);
+
+  ChunkedWriter out;
+  out.begin(csv ? "text/csv" : "application/x-ndjson");
+  if (csv) out.print("timestamp,leftTemp,rightTemp,setpointLeft,setpointRight,leftRaw,rightRaw,faults,unsynced\n");
+
+  char l[12], r[12], lr[12], rr[12], flags[40];
+  uint32_t exported = 0;
+  unsigned long start = millis();
+  historyForEach(fromTs, toTs, [&](const TemperatureLogEntry& e) {
+    if (csv) {
+      // Empty fields for missing values
+      auto field = [](char* buf, size_t size, float v) { if (isnan(v)) buf[0] = '\0'; else snprintf(buf, size, "%.2f", v); };
+      field(l, sizeof(l), e.leftTemp);
+      field(r, sizeof(r), e.rightTemp);
+      field(lr, sizeof(lr), e.leftRaw);
+      field(rr, sizeof(rr), e.rightRaw);
+      out.printf("%lu,%s,%s,%.2f,%.2f,%s,%s,%u,%u\n", (unsigned long)e.timestamp, l, r,
+        e.setpointLeft, e.setpointRight, lr, rr, e.faults & ~LOG_FLAG_UNSYNCED, (e.faults & LOG_FLAG_UNSYNCED) ? 1 : 0);
+    } else {
+      writeJsonTemp(l, sizeof(l), e.leftTemp);
+      writeJsonTemp(r, sizeof(r), e.rightTemp);
+      writeJsonTemp(lr, sizeof(lr), e.leftRaw);
+      writeJsonTemp(rr, sizeof(rr), e.rightRaw);
+      formatLogFlags(flags, sizeof(flags), e.faults);
+      out.printf("{\"timestamp\":%lu,\"leftTemp\":%s,\"rightTemp\":%s,\"setpointLeft\":%.2f,\"setpointRight\":%.2f,"
+                 "\"leftRaw\":%s,\"rightRaw\":%s%s}\n",
+        (unsigned long)e.timestamp, l, r, e.setpointLeft, e.setpointRight, lr, rr, flags);
+    }
+
+    // A long export must not hold up sampling and compressor control
+    if (++exported % EXPORT_SERVICE_EVERY == 0) {
+      serviceSensorsAndControl();
+      if (!out.connected()) return false;
+    }
+    return true;
+  });
+  out.end();
+
+  LOGI(LOG_WEB, "Exported %lu entries in %lu ms", (unsigned long)exported, millis() - start);
+}
+
+String getHistoryInfoJSON() {
+  DynamicJsonDocument doc(1536);
+  doc["ready"] = history.ready;
+  doc["staged"] = history.stageCount;
+  doc["flushes"] = history.flushes;
+  doc["writeErrors"] = history.writeErrors;
+  doc["maxSegments"] = HIST_MAX_SEGMENTS;
+  doc["segmentRecords"] = HIST_SEGMENT_RECORDS;
+  doc["entrySize"] = sizeof(TemperatureLogEntry);
+  doc["entriesWritten"] = history.entriesWritten;
+  doc["bytesWritten"] = history.bytesWritten;
+  if (history.entriesWritten > 0) {
+    doc["bytesPerEntry"] = (float)history.bytesWritten / history.entriesWritten;
+    doc["compressionRatio"] = (float)history.entriesWritten * sizeof(TemperatureLogEntry) / history.bytesWritten;
   }
 
-  // Store in circular buffer
-  tempLog[logHead] = {currentTimestamp, state.leftTemp, state.rightTemp, config.leftSetpoint, config.rightSetpoint};
-  logHead = (logHead + 1) % MAX_LOG_ENTRIES;
-  if (logCount < MAX_LOG_ENTRIES) {
-    logCount++;
+  uint32_t total = 0, bytes = 0;
+  JsonArray segments = doc.createNestedArray("segments");
+  for (int i = 0; i < history.segmentCount; i++) {
+    JsonObject seg = segments.createNestedObject();
+    seg["id"] = history.segments[i].segmentId;
+    seg["from"] = history.segments[i].firstTimestamp;
+    seg["to"] = history.segments[i].lastTimestamp;
+    seg["count"] = history.segments[i].count;
+    total += history.segments[i].count;
+    File file = LittleFS.open(historySegmentPath(history.segments[i].segmentId), "r");
+    if (file) {
+      seg["bytes"] = file.size();
+      bytes += file.size();
+      file.close();
+    }
+  }
+  doc["records"] = total;
+  doc["bytes"] = bytes;
+
+  JsonObject clock = doc.createNestedObject("time");
+  clock["synced"] = timeBase.synced;
+  clock["bootStart"] = timeBase.bootStart;
+  clock["syncOffset"] = timeBase.syncOffset;
+  clock["correctedEntries"] = timeBase.correctedEntries;
+  clock["flashCorrections"] = timeCorrectionCount;
+
+  JsonObject ram = doc.createNestedObject("ram");
+  ram["location"] = logInPsram ? "psram" : "internal";
+  ram["capacity"] = logCapacity;
+  ram["entries"] = logCount;
+  ram["bytes"] = logCapacity * sizeof(PackedLogRecord);
+  ram["appendUsMax"] = logTiming.appendUsMax;
+  ram["appendUsAvg"] = logTiming.appends ? (float)logTiming.appendUsTotal / logTiming.appends : 0.0;
+  ram["tickUsMax"] = logTiming.tickUsMax;
+#ifdef LOG_BUFFER_BENCHMARK
+  JsonObject bench = ram.createNestedObject("benchmark");
+  bench["fillUs"] = logTiming.fillUs;
+  bench["scanUs"] = logTiming.scanUs;
+  bench["randomReadsUs"] = logTiming.randomReadUs;
+#endif
+
+  JsonArray tiers = doc.createNestedArray("tiers");
+  for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+    JsonObject tier = tiers.createNestedObject();
+    tier["name"] = historyTiers[i].name;
+    tier["step"] = historyTiers[i].step;
+    tier["capacity"] = historyTiers[i].capacity;
+    tier["ready"] = historyTiers[i].ready;
+    tier["bytes"] = sizeof(TierHeader) + historyTiers[i].capacity * sizeof(HistoryAggregate);
   }
 
-  Serial.printf("Temps - Left: %.2f°C, Right: %.2f°C", state.leftTemp, state.rightTemp);
-  if (TESTING_MODE) {
-    Serial.print(" [TESTING MODE]");
+  String output;
+  serializeJson(doc, output);
+  return output;
+}
+
+// Sampling, control evaluation and history logging each run on their own configurable interval
+void serviceSensorsAndControl() {
+  unsigned long now = millis();
+  unsigned long tickStart = micros();
+
+  if (now - state.lastTempRead >= config.sampleIntervalMs) {
+    readTemperatures();
+    state.lastTempRead = now;
+  }
+
+  // Main control logic (only if not in manual mode)
+  if (now - state.lastControlRun >= config.controlIntervalMs) {
+    if (!state.manualMode) {
+      controlLogic();
+    }
+    state.lastControlRun = now;
+    otaValidation.controlTicks++;
   }
-  if (state.manualMode) {
-    Serial.print(" [MANUAL MODE]");
+
+  if (now - state.lastLogWrite >= config.logIntervalMs) {
+    recordTemperatureLog();
+    state.lastLogWrite = now;
   }
-  Serial.println();
+
+  logTiming.tickUsMax = max(logTiming.tickUsMax, (uint32_t)(micros() - tickStart));
 }
 
 void controlLogic() {
@@ -867,7 +3756,7 @@ void controlLogic() {
   
   if (!state.systemEnabled) {
     if (state.compressorOn) {
-      stopCompressor();
+      stopCompressor(STOP_DISABLED);
     }
     state.status = "System Disabled";
     return;
@@ -884,12 +3773,27 @@ void controlLogic() {
                       (state.leftTemp <= config.leftSetpoint - config.hysteresis);
   bool rightSatisfied = !config.rightEnabled || 
                        (state.rightTemp <= config.rightSetpoint - config.hysteresis);
+
+  // A faulted sensor can't be trusted - run that zone on the timed fallback cycle instead
+  if (leftHealth.faulted) {
+    leftNeedsCooling = config.leftEnabled && faultDutyActive(leftHealth, now);
+    leftSatisfied = !leftNeedsCooling;
+  }
+  if (rightHealth.faulted) {
+    rightNeedsCooling = config.rightEnabled && faultDutyActive(rightHealth, now);
+    rightSatisfied = !rightNeedsCooling;
+  }
   
   // Determine which zone to cool
   int targetZone = -1;
   if (leftNeedsCooling && rightNeedsCooling) {
-    // Both need cooling - choose the one that's warmer
-    targetZone = (state.leftTemp > state.rightTemp) ? 0 : 1;
+    if (leftHealth.faulted || rightHealth.faulted) {
+      // No valid comparison possible - stay on the current zone to avoid extra switching
+      targetZone = state.currentZone;
+    } else {
+      // Both need cooling - choose the one that's warmer
+      targetZone = (state.leftTemp > state.rightTemp) ? 0 : 1;
+    }
   } else if (leftNeedsCooling) {
     targetZone = 0;
   } else if (rightNeedsCooling) {
@@ -900,25 +3804,33 @@ void controlLogic() {
   if (state.compressorOn) {
     // Compressor is running
     bool shouldStop = false;
+    uint8_t stopReason = STOP_OTHER;
     
     // Check max run time
     if (now - state.lastCompressorStart > config.maxRunTime * 60000) {
       shouldStop = true;
+      stopReason = STOP_MAX_RUN;
       state.status = "Max run time reached";
+      if (!state.maxRunCutoff) {
+        state.maxRunCutoff = true;
+        recordControlEvent(EVT_MAX_RUN_CUTOFF, state.currentZone);
+      }
     }
     
     // Check if current zone is satisfied
     if (state.currentZone == 0 && leftSatisfied) {
       shouldStop = true;
+      stopReason = STOP_SATISFIED;
       state.status = "Left zone satisfied";
     } else if (state.currentZone == 1 && rightSatisfied) {
       shouldStop = true;
+      stopReason = STOP_SATISFIED;
       state.status = "Right zone satisfied";
     }
     
     // Check minimum run time before allowing stop
     if (shouldStop && (now - state.lastCompressorStart >= config.minRunTime * 60000)) {
-      stopCompressor();
+      stopCompressor(stopReason);
     }
     
     // Check if we need to switch zones
@@ -953,6 +3865,7 @@ void controlLogic() {
 void startCompressor(int zone) {
   state.compressorOn = true;
   state.lastCompressorStart = millis();
+  state.maxRunCutoff = false;
 
   switchZone(zone);  // Sets state.currentZone
 
@@ -961,11 +3874,13 @@ void startCompressor(int zone) {
   state.rightCooling = (zone == 1);
 
   digitalWrite(COMPRESSOR_PIN, HIGH); // Turn on compressor (assuming active high)
+  recordControlEvent(EVT_COMPRESSOR_START, zone);
   state.status = String("Cooling ") + (zone == 0 ? "Left" : "Right") + " zone";
-  Serial.println("Compressor started - " + state.status);
+  LOGI(LOG_CTRL, "Compressor started - %s", state.status.c_str());
 }
 
-void stopCompressor() {
+void stopCompressor(uint8_t reason) {
+  bool wasOn = state.compressorOn;
   state.compressorOn = false;
   state.lastCompressorStop = millis();
 
@@ -974,22 +3889,26 @@ void stopCompressor() {
   state.rightCooling = false;
 
   digitalWrite(COMPRESSOR_PIN, LOW); // Turn off compressor
+  if (wasOn) recordControlEvent(EVT_COMPRESSOR_STOP, state.currentZone, reason);
   state.status = "Compressor stopped";
-  Serial.println("Compressor stopped");
+  LOGI(LOG_CTRL, "Compressor stopped");
 }
 
 void switchZone(int zone) {
-  if (zone != state.currentZone) {
-    state.lastZoneSwitch = millis();
-  }
+  bool changed = zone != state.currentZone;
+  if (changed) state.lastZoneSwitch = millis();
 
   state.currentZone = zone;
   state.solenoidOn = (zone == 1);
   digitalWrite(SOLENOID_PIN, zone == 1 ? HIGH : LOW);
-  Serial.printf("Switched to %s zone\n", zone == 0 ? "Left" : "Right");
+  if (changed) recordControlEvent(EVT_ZONE_SWITCH, zone);
+  LOGI(LOG_CTRL, "Switched to %s zone", zone == 0 ? "Left" : "Right");
 }
 
 void setupWebServer() {
+  const char* headerKeys[] = {"Content-Type", "Content-Length"};
+  server.collectHeaders(headerKeys, 2);
+
   // Captive portal detection handlers - redirect to main page
   server.on("/generate_204", HTTP_GET, []() {
     server.sendHeader("Location", "/", true);
@@ -1051,8 +3970,106 @@ void setupWebServer() {
     server.send(200, "application/json", getConfigJSON());
   });
 
+  // Recent log entries: /api/logs[?from=<unix>][&to=<unix>][&limit=<n>]
   server.on("/api/logs", HTTP_GET, []() {
-    server.send(200, "application/json", getLogsJSON());
+    uint32_t fromTs = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : 0;
+    uint32_t toTs = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+    int limit = server.hasArg("limit") ? server.arg("limit").toInt() : 0;
+    if (fromTs > toTs || limit < 0) {
+      server.send(400, "application/json", "{\"error\":\"invalid range\"}");
+      return;
+    }
+    sendLogsJSON(fromTs, toTs, limit);
+  });
+
+  // Runtime log level control, e.g. {"level":"warn"} or {"modules":{"sensor":"debug"}}
+  server.on("/api/log/level", HTTP_GET, []() {
+    server.send(200, "application/json", getLogConfigJSON());
+  });
+
+  server.on("/api/log/level", HTTP_POST, []() {
+    if (!server.hasArg("plain")) {
+      server.send(400, "application/json", "{\"error\":\"No data\"}");
+      return;
+    }
+
+    DynamicJsonDocument doc(512);
+    if (deserializeJson(doc, server.arg("plain"))) {
+      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+      return;
+    }
+
+    if (doc.containsKey("level")) {
+      int level = parseLogLevel(doc["level"].as<String>());
+      if (level < 0) {
+        server.send(400, "application/json", "{\"error\":\"Unknown level\"}");
+        return;
+      }
+      for (int i = 0; i < LOG_MODULE_COUNT; i++) logLevels[i] = level;
+    }
+
+    JsonObject modules = doc["modules"];
+    for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+      if (modules.containsKey(LOG_MODULE_NAMES[i])) {
+        int level = parseLogLevel(modules[LOG_MODULE_NAMES[i]].as<String>());
+        if (level >= 0) logLevels[i] = level;
+      }
+    }
+
+    server.send(200, "application/json", getLogConfigJSON());
+  });
+
+  // Rolling per-zone statistics (1 h / 24 h / 7 d), maintained as samples arrive
+  server.on("/api/stats", HTTP_GET, []() {
+    server.send(200, "application/json", getStatsJSON());
+  });
+
+  // Control event journal, newest first: /api/events/history[?before=<seq>][&limit=<n>]
+  server.on("/api/events/history", HTTP_GET, []() {
+    uint32_t before = server.hasArg("before") ? strtoul(server.arg("before").c_str(), nullptr, 10) : 0;
+    int limit = server.hasArg("limit") ? server.arg("limit").toInt() : 50;
+    limit = constrain(limit, 1, CONTROL_EVENT_PAGE_MAX);
+    server.send(200, "application/json", getControlEventsJSON(before, limit));
+  });
+
+  // Bulk export from flash: /api/export?from=<unix>&to=<unix>&format=csv|ndjson
+  server.on("/api/export", HTTP_GET, []() {
+    // Entries logged while the export runs are left for the next one
+    bool synced;
+    uint32_t now = logTimestamp(synced);
+    uint32_t toTs = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : now;
+    uint32_t fromTs = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : 0;
+    String format = server.hasArg("format") ? server.arg("format") : String("csv");
+    if (fromTs > toTs || (format != "csv" && format != "ndjson")) {
+      server.send(400, "application/json", "{\"error\":\"need from <= to and format csv or ndjson\"}");
+      return;
+    }
+    sendHistoryExport(fromTs, toTs, format == "csv");
+  });
+
+  // Tiered history: /api/history?from=<unix>&to=<unix>[&tier=raw|1m|15m]
+  server.on("/api/history", HTTP_GET, []() {
+    uint32_t now = time(nullptr);
+    uint32_t toTs = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : now;
+    uint32_t fromTs = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : toTs - RAW_TIER_SPAN_SEC;
+    if (fromTs > toTs) {
+      server.send(400, "application/json", "{\"error\":\"from must not be after to\"}");
+      return;
+    }
+    String tier = server.hasArg("tier") ? server.arg("tier") : String("");
+    bool knownTier = tier.length() == 0 || tier == "raw";
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      if (tier == historyTiers[i].name) knownTier = true;
+    }
+    if (!knownTier) {
+      server.send(400, "application/json", "{\"error\":\"tier must be raw, 1m or 15m\"}");
+      return;
+    }
+    sendHistoryJSON(fromTs, toTs, tier);
+  });
+
+  server.on("/api/history/info", HTTP_GET, []() {
+    server.send(200, "application/json", getHistoryInfoJSON());
   });
 
   server.on("/api/ota/status", HTTP_GET, []() {
@@ -1061,7 +4078,7 @@ void setupWebServer() {
 
   // Check for updates (does NOT install - just returns version info)
   server.on("/api/ota/check", HTTP_GET, []() {
-    Serial.println("🔍 Checking for updates via web interface...");
+    LOGI(LOG_OTA, "Checking for updates via web interface...");
     GitHubRelease update = checkForUpdates();
     lastUpdateCheck = millis();
 
@@ -1080,7 +4097,7 @@ void setupWebServer() {
 
   // Install update (assumes check already done, proceeds with download/install)
   server.on("/api/ota/update", HTTP_POST, []() {
-    Serial.println("🔄 Manual OTA install triggered via web interface");
+    LOGI(LOG_OTA, "Manual OTA install triggered via web interface");
     
     // Get the download URL from the request body if provided, otherwise check again
     String downloadUrl = "";
@@ -1107,7 +4124,7 @@ void setupWebServer() {
       return;
     }
 
-    Serial.printf("📦 Installing update from: %s\n", downloadUrl.c_str());
+    LOGI(LOG_OTA, "Installing update from: %s", downloadUrl.c_str());
     
     // Send response before starting update (update will restart ESP)
     server.send(200, "application/json", "{\"success\":true,\"message\":\"Update installation started. Device will restart when complete.\"}");
@@ -1116,14 +4133,50 @@ void setupWebServer() {
     delay(100);
     
     if (downloadAndInstallFirmware(downloadUrl)) {
-      Serial.println("✅ Update successful - restarting...");
+      LOGI(LOG_OTA, "Update successful - restarting...");
+      flushHistory();
+      flushControlEvents();
+      saveConfig();
       delay(1000);
       ESP.restart();
     } else {
-      Serial.println("❌ Update failed");
+      LOGE(LOG_OTA, "Update failed");
       // Can't send response here since we already sent one
     }
   });
+
+  // Push an image from the LAN: raw body (application/octet-stream) or multipart form upload,
+  // e.g. curl --data-binary @firmware.bin "http://<device>/api/ota/upload?sha256=<hex>"
+  server.on("/api/ota/upload", HTTP_POST, []() {
+    if (!otaUpload.ok) {
+      DynamicJsonDocument response(256);
+      response["success"] = false;
+      response["error"] = otaUpload.error.length() ? otaUpload.error : String("no firmware received");
+      String output;
+      serializeJson(response, output);
+      server.send(otaUpload.error.length() ? otaUpload.status : 400, "application/json", output);
+      return;
+    }
+
+    server.send(200, "application/json", "{\"success\":true,\"bytes\":" + String((unsigned long)otaProgress.imageBytes) +
+      ",\"message\":\"Firmware verified. Device will restart.\"}");
+    LOGI(LOG_OTA, "Uploaded firmware installed - restarting...");
+    flushHistory();
+    flushControlEvents();
+    saveConfig();
+    delay(1000);
+    ESP.restart();
+  }, []() {
+    // HTTPUploadStatus and HTTPRawStatus share the start/write/end/aborted order
+    static const uint8_t phases[] = {OTA_UPLOAD_START, OTA_UPLOAD_WRITE, OTA_UPLOAD_END, OTA_UPLOAD_ABORTED};
+    if (server.header("Content-Type").startsWith("multipart/")) {
+      HTTPUpload& upload = server.upload();
+      otaUploadStep(phases[upload.status], upload.buf, upload.currentSize);
+    } else {
+      HTTPRaw& raw = server.raw();
+      otaUploadStep(phases[raw.status], raw.buf, raw.currentSize);
+    }
+  });
   
   server.on("/api/config", HTTP_POST, []() {
     if (server.hasArg("plain")) {
@@ -1134,14 +4187,49 @@ void setupWebServer() {
     }
   });
   
+  // Full config snapshot for provisioning: /api/config/export[?secrets=1]
+  server.on("/api/config/export", HTTP_GET, []() {
+    sendConfigSnapshot(server.arg("secrets") == "1");
+  });
+
+  // Apply an exported snapshot; validated as a whole and committed in one write
+  server.on("/api/config/import", HTTP_POST, []() {
+    if (!server.hasArg("plain")) {
+      server.send(400, "application/json", "{\"error\":\"No data\"}");
+      return;
+    }
+    DynamicJsonDocument doc(4096);
+    if (deserializeJson(doc, server.arg("plain"))) {
+      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+      return;
+    }
+
+    String error;
+    int applied = 0;
+    if (!importConfigSnapshot(doc.as<JsonObject>(), error, applied)) {
+      LOGW(LOG_CFG, "Config import rejected: %s", error.c_str());
+      DynamicJsonDocument response(256);
+      response["error"] = error;  // May echo a key from the request, so let ArduinoJson escape it
+      String output;
+      serializeJson(response, output);
+      server.send(400, "application/json", output);
+      return;
+    }
+    LOGI(LOG_CFG, "Config snapshot imported: %d fields, seq %lu", applied, (unsigned long)configSeq);
+    server.send(200, "application/json", "{\"success\":true,\"applied\":" + String(applied) +
+      ",\"seq\":" + String(configSeq) + "}");
+  });
+
   server.on("/api/system", HTTP_POST, []() {
     if (server.hasArg("action")) {
       String action = server.arg("action");
       if (action == "enable") {
         state.systemEnabled = true;
         state.manualMode = false; // Exit manual mode when enabling system
+        recordControlEvent(EVT_SYSTEM, EVENT_ZONE_NONE, 1);
       } else if (action == "disable") {
         state.systemEnabled = false;
+        recordControlEvent(EVT_SYSTEM, EVENT_ZONE_NONE, 0);
       }
       server.send(200, "application/json", "{\"success\":true}");
     }
@@ -1155,9 +4243,9 @@ void setupWebServer() {
 
       if (doc.containsKey("enabled")) {
         config.autoUpdatesEnabled = doc["enabled"];
-        saveConfig();
+        markConfigDirty();
         server.send(200, "application/json", "{\"success\":true,\"autoUpdatesEnabled\":" + String(config.autoUpdatesEnabled ? "true" : "false") + "}");
-        Serial.printf("Auto-updates %s\n", config.autoUpdatesEnabled ? "enabled" : "disabled");
+        LOGI(LOG_OTA, "Auto-updates %s", config.autoUpdatesEnabled ? "enabled" : "disabled");
       } else {
         server.send(400, "application/json", "{\"error\":\"Missing enabled field\"}");
       }
@@ -1176,7 +4264,8 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
       digitalWrite(COMPRESSOR_PIN, HIGH); // Turn on compressor (assuming active high)
       state.compressorOn = true;
       state.status = "Manual Compressor ON";
-      Serial.println("Manual: Compressor turned ON");
+      recordControlEvent(EVT_MANUAL, state.currentZone, MANUAL_COMPRESSOR_ON);
+      LOGI(LOG_CTRL, "Manual: Compressor turned ON");
     } else if (action == "off") {
       // Manual compressor off
       state.manualMode = true;
@@ -1185,12 +4274,14 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
       state.leftCooling = false;
       state.rightCooling = false;
       state.status = "Manual Compressor OFF";
-      Serial.println("Manual: Compressor turned OFF");
+      recordControlEvent(EVT_MANUAL, state.currentZone, MANUAL_COMPRESSOR_OFF);
+      LOGI(LOG_CTRL, "Manual: Compressor turned OFF");
     } else if (action == "auto") {
       // Return to automatic control
       state.manualMode = false;
       state.status = "Returned to automatic control";
-      Serial.println("Manual: Returned to automatic control");
+      recordControlEvent(EVT_MANUAL, EVENT_ZONE_NONE, MANUAL_AUTO);
+      LOGI(LOG_CTRL, "Manual: Returned to automatic control");
     }
     server.send(200, "application/json", "{\"success\":true}");
   } else {
@@ -1207,19 +4298,22 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
         state.solenoidOn = false;
         state.currentZone = 0;
         state.status = "Manual Solenoid: LEFT zone";
-        Serial.println("Manual: Solenoid switched to LEFT zone");
+        recordControlEvent(EVT_MANUAL, 0, MANUAL_SOLENOID_LEFT);
+        LOGI(LOG_CTRL, "Manual: Solenoid switched to LEFT zone");
       } else if (action == "right") {
         state.manualMode = true;
         digitalWrite(SOLENOID_PIN, HIGH);
         state.solenoidOn = true;
         state.currentZone = 1;
         state.status = "Manual Solenoid: RIGHT zone";
-        Serial.println("Manual: Solenoid switched to RIGHT zone");
+        recordControlEvent(EVT_MANUAL, 1, MANUAL_SOLENOID_RIGHT);
+        LOGI(LOG_CTRL, "Manual: Solenoid switched to RIGHT zone");
       } else if (action == "auto") {
         // Return to automatic control
         state.manualMode = false;
         state.status = "Returned to automatic control";
-        Serial.println("Manual: Returned to automatic control");
+        recordControlEvent(EVT_MANUAL, EVENT_ZONE_NONE, MANUAL_AUTO);
+        LOGI(LOG_CTRL, "Manual: Returned to automatic control");
       }
       server.send(200, "application/json", "{\"success\":true}");
     } else {
@@ -1229,7 +4323,7 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
 
   // WiFi network scan endpoint
   server.on("/api/wifi/scan", HTTP_GET, []() {
-    Serial.println("WiFi scan requested");
+    LOGD(LOG_NET, "WiFi scan requested");
     int n = WiFi.scanNetworks();
     
     DynamicJsonDocument doc(2048);
@@ -1257,7 +4351,7 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
     String output;
     serializeJson(doc, output);
     server.send(200, "application/json", output);
-    Serial.printf("Found %d networks\n", n);
+    LOGD(LOG_NET, "Found %d networks", n);
   });
 
   // Multi-network WiFi configuration endpoint
@@ -1295,8 +4389,8 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
           }
         }
 
-        saveConfig();
-        Serial.printf("Multi-network WiFi config saved: %d networks\n", networkCount);
+        markConfigDirty();
+        LOGI(LOG_NET, "Multi-network WiFi config saved: %d networks", networkCount);
 
         // Trigger reconnection attempt
         WiFi.disconnect();
@@ -1323,8 +4417,8 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
           config.wifiNetworks[0].enabled = true;
         }
 
-        saveConfig();
-        Serial.printf("Single-network WiFi config saved: %s\n", config.wifiNetworks[0].ssid);
+        markConfigDirty();
+        LOGI(LOG_NET, "Single-network WiFi config saved: %s", config.wifiNetworks[0].ssid);
 
         // Attempt to connect
         WiFi.disconnect();
@@ -1368,17 +4462,20 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
       if (doc.containsKey("actualTemp")) {
         float actualTemp = doc["actualTemp"];
 
+        // Automatic mode: sample until stable, poll /api/calibration/capture for progress
+        if (doc["auto"] | false) {
+          startCalibrationCapture(1, actualTemp, doc["varianceThreshold"] | CAL_CAPTURE_VARIANCE_MAX);
+          server.send(202, "application/json", "{\"success\":true,\"point\":1,\"capturing\":true}");
+          return;
+        }
+
         // Record resistances at current readings
         int leftReading = analogRead(NTC_LEFT_PIN);
         int rightReading = analogRead(NTC_RIGHT_PIN);
 
-        config.calPoint1ResistanceLeft = SERIES_RESISTOR * (4095.0 / leftReading - 1.0);
-        config.calPoint1ResistanceRight = SERIES_RESISTOR * (4095.0 / rightReading - 1.0);
-        config.calPoint1Temp = actualTemp;
-
-        saveConfig();
-        Serial.printf("Calibration Point 1 set: %.1f°C, R_left=%.1f, R_right=%.1f\n",
-          actualTemp, config.calPoint1ResistanceLeft, config.calPoint1ResistanceRight);
+        commitCalibrationPoint(1, actualTemp,
+          SERIES_RESISTOR * (4095.0 / leftReading - 1.0),
+          SERIES_RESISTOR * (4095.0 / rightReading - 1.0));
 
         server.send(200, "application/json", "{\"success\":true,\"point\":1,\"resistanceLeft\":" +
           String(config.calPoint1ResistanceLeft) + ",\"resistanceRight\":" +
@@ -1399,20 +4496,19 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
       if (doc.containsKey("actualTemp")) {
         float actualTemp = doc["actualTemp"];
 
-        // Record resistances at current readings
+        if (doc["auto"] | false) {
+          startCalibrationCapture(2, actualTemp, doc["varianceThreshold"] | CAL_CAPTURE_VARIANCE_MAX);
+          server.send(202, "application/json", "{\"success\":true,\"point\":2,\"capturing\":true}");
+          return;
+        }
+
+        // Record resistances at current readings and calculate beta coefficient
         int leftReading = analogRead(NTC_LEFT_PIN);
         int rightReading = analogRead(NTC_RIGHT_PIN);
 
-        config.calPoint2ResistanceLeft = SERIES_RESISTOR * (4095.0 / leftReading - 1.0);
-        config.calPoint2ResistanceRight = SERIES_RESISTOR * (4095.0 / rightReading - 1.0);
-        config.calPoint2Temp = actualTemp;
-
-        // Calculate beta coefficient
-        calculateNTCBeta();
-        saveConfig();
-
-        Serial.printf("Calibration Point 2 set: %.1f°C, R_left=%.1f, R_right=%.1f\n",
-          actualTemp, config.calPoint2ResistanceLeft, config.calPoint2ResistanceRight);
+        commitCalibrationPoint(2, actualTemp,
+          SERIES_RESISTOR * (4095.0 / leftReading - 1.0),
+          SERIES_RESISTOR * (4095.0 / rightReading - 1.0));
 
         String response = "{\"success\":true,\"point\":2,\"calibrated\":" +
           String(config.ntcCalibrated ? "true" : "false") + ",\"beta\":" +
@@ -1460,6 +4556,19 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
     server.send(200, "application/json", output);
   });
 
+  server.on("/api/calibration/capture", HTTP_GET, []() {
+    server.send(200, "application/json", getCalibrationCaptureJSON());
+  });
+
+  server.on("/api/calibration/capture/cancel", HTTP_POST, []() {
+    if (calCapture.active) {
+      calCapture.active = false;
+      calCapture.result = "cancelled";
+      LOGI(LOG_SENSOR, "Calibration capture cancelled");
+    }
+    server.send(200, "application/json", "{\"success\":true}");
+  });
+
   server.on("/api/calibration/reset", HTTP_POST, []() {
     config.ntcCalibrated = false;
     config.calPoint1ResistanceLeft = 2500;
@@ -1470,8 +4579,8 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
     config.customNominalTemp = 0;
     config.customNominalResistance = 0;
 
-    saveConfig();
-    Serial.println("NTC calibration reset to defaults");
+    markConfigDirty();
+    LOGI(LOG_SENSOR, "NTC calibration reset to defaults");
 
     server.send(200, "application/json", "{\"success\":true,\"message\":\"Calibration reset\"}");
   });
@@ -1480,7 +4589,7 @@ server.on("/api/manual/compressor", HTTP_POST, []() {
 String getMainPage() {
   File file = LittleFS.open("/index.html", "r");
   if (!file) {
-    Serial.println("Failed to open /index.html from LittleFS");
+    LOGW(LOG_WEB, "Failed to open /index.html from LittleFS");
     return "<html><body><h1>File Not Found</h1><p>Could not load index.html from LittleFS.</p><p>Please upload filesystem image!</p></body></html>";
   }
 
@@ -1494,22 +4603,22 @@ String getMainPage() {
 }
 
 String getBasicPage() {
-  Serial.println("Serving embedded basic.html");
+  LOGD(LOG_WEB, "Serving embedded basic.html");
   return FPSTR(HTML_BASIC);
 }
 
 String getManualPage() {
-  Serial.println("Serving embedded manual.html");
+  LOGD(LOG_WEB, "Serving embedded manual.html");
   return FPSTR(HTML_MANUAL);
 }
 
 String getChartsPage() {
-  Serial.println("Serving embedded charts.html");
+  LOGD(LOG_WEB, "Serving embedded charts.html");
   return FPSTR(HTML_CHARTS);
 }
 
 String getSettingsPage() {
-  Serial.println("Serving embedded settings.html");
+  LOGD(LOG_WEB, "Serving embedded settings.html");
   return FPSTR(HTML_SETTINGS);
 }
 
@@ -1528,6 +4637,25 @@ String getStatusJSON() {
   doc["uptime"] = millis() / 1000;
   doc["testingMode"] = TESTING_MODE;
 
+  // Sensor health
+  doc["leftFaulted"] = leftHealth.faulted;
+  doc["rightFaulted"] = rightHealth.faulted;
+  doc["leftSensor"] = sensorFaultName(leftHealth.faulted ? leftHealth.fault : leftHealth.lastReading);
+  doc["rightSensor"] = sensorFaultName(rightHealth.faulted ? rightHealth.fault : rightHealth.lastReading);
+  doc["leftFaultEvents"] = leftHealth.faultEvents;
+  doc["rightFaultEvents"] = rightHealth.faultEvents;
+  doc["faultFallbackActive"] = leftHealth.faulted || rightHealth.faulted;
+  if (isnan(state.leftTemp)) doc["leftTemp"] = nullptr;
+  if (isnan(state.rightTemp)) doc["rightTemp"] = nullptr;
+
+  // Unfiltered readings alongside the filtered values used for control
+  if (isnan(state.leftTempRaw)) doc["leftTempRaw"] = nullptr; else doc["leftTempRaw"] = state.leftTempRaw;
+  if (isnan(state.rightTempRaw)) doc["rightTempRaw"] = nullptr; else doc["rightTempRaw"] = state.rightTempRaw;
+  if (config.filterMode == FILTER_KALMAN) {
+    doc["leftRate"] = leftFilter.rate;
+    doc["rightRate"] = rightFilter.rate;
+  }
+
   // Network status
   doc["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
   doc["wifiSSID"] = WiFi.SSID();
@@ -1551,6 +4679,13 @@ String getConfigJSON() {
   doc["tempOffset"] = config.tempOffset;
   doc["leftEnabled"] = config.leftEnabled;
   doc["rightEnabled"] = config.rightEnabled;
+  doc["filterMode"] = config.filterMode;
+  doc["filterTimeConstant"] = config.filterTimeConstant;
+  doc["kalmanProcessNoise"] = config.kalmanProcessNoise;
+  doc["kalmanMeasurementNoise"] = config.kalmanMeasurementNoise;
+  doc["sampleIntervalMs"] = config.sampleIntervalMs;
+  doc["controlIntervalMs"] = config.controlIntervalMs;
+  doc["logIntervalMs"] = config.logIntervalMs;
 
   String output;
   serializeJson(doc, output);
@@ -1573,117 +4708,583 @@ void updateConfig(String jsonStr) {
   if (doc.containsKey("tempOffset")) config.tempOffset = doc["tempOffset"];
   if (doc.containsKey("leftEnabled")) config.leftEnabled = doc["leftEnabled"];
   if (doc.containsKey("rightEnabled")) config.rightEnabled = doc["rightEnabled"];
+  if (doc.containsKey("filterMode")) {
+    uint8_t mode = doc["filterMode"];
+    if (mode <= FILTER_KALMAN && mode != config.filterMode) {
+      config.filterMode = mode;
+      leftFilter.initialized = false;  // Restart both filters from the next reading
+      rightFilter.initialized = false;
+    }
+  }
+  if (doc.containsKey("filterTimeConstant")) config.filterTimeConstant = constrain(doc["filterTimeConstant"].as<float>(), 1.0f, 600.0f);
+  if (doc.containsKey("kalmanProcessNoise")) config.kalmanProcessNoise = constrain(doc["kalmanProcessNoise"].as<float>(), 1e-7f, 1.0f);
+  if (doc.containsKey("kalmanMeasurementNoise")) config.kalmanMeasurementNoise = constrain(doc["kalmanMeasurementNoise"].as<float>(), 1e-4f, 10.0f);
+  if (doc.containsKey("sampleIntervalMs")) config.sampleIntervalMs = constrain(doc["sampleIntervalMs"].as<uint32_t>(), 20u, 5000u);
+  if (doc.containsKey("controlIntervalMs")) config.controlIntervalMs = constrain(doc["controlIntervalMs"].as<uint32_t>(), 100u, 10000u);
+  if (doc.containsKey("logIntervalMs")) config.logIntervalMs = constrain(doc["logIntervalMs"].as<uint32_t>(), 1000u, 600000u);
 
   // WiFi config no longer handled here - managed by ESPWifiConfig library
 
-  saveConfig();
-}
+  // Fields without an explicit clamp above fall back to their defaults when out of range
+  if (sanitizeConfig(config)) {
+    LOGW(LOG_CFG, "Out-of-range config values reset to defaults");
+  }
 
-void saveConfig() {
-  EEPROM.put(0, config);
-  EEPROM.commit();
+  markConfigDirty();
 }
 
+// ---- Config store (NVS) ----
+// Each Config field is its own NVS key, described by CONFIG_FIELDS. Commits alternate between
+// two slots (NVS namespaces), each holding a schema version, a sequence number and a CRC over
+// all values. Boot takes the valid slot with the highest sequence number, so an interrupted
+// commit falls back to the previous one; saves only write the keys that changed.
+#define CONFIG_SCHEMA_VERSION 2        // 0 = legacy EEPROM struct image, 1 = single NVS store
+const char* const CONFIG_SLOT_NAMESPACES[2] = {"fridgecfg", "fridgecfgb"};  // Slot A keeps the schema 1 name
+
+enum ConfigFieldType : uint8_t {
+  CFG_FLOAT,
+  CFG_BOOL,
+  CFG_U8,
+  CFG_U32,
+  CFG_STR,
+};
 
+struct ConfigField {
+  const char* key;             // NVS key (at most 15 characters)
+  ConfigFieldType type;
+  uint16_t offset;             // Into Config
+  uint16_t size;               // Buffer size for strings
+  float minValue;              // Valid range; min == max means unchecked
+  float maxValue;
+  float fallback;              // Used when the stored value is out of range
+  uint8_t flags;               // CFG_FLAG_*
+};
 
-bool factoryDefaultsLoaded = false;
+#define CFG_FLAG_CRITICAL 0x01     // Saved immediately instead of on the deferred flush
+#define CFG_FLAG_SECRET 0x02       // Left out of config exports unless asked for
+
+#define CFG_FIELD_DEF(key, type, member, lo, hi, fallback, flags) \
+  {key, type, (uint16_t)offsetof(Config, member), (uint16_t)sizeof(((Config*)0)->member), lo, hi, fallback, flags}
+#define CFG_FIELD(key, type, member, lo, hi, fallback) CFG_FIELD_DEF(key, type, member, lo, hi, fallback, 0)
+// Losing these to a power cut means re-entering credentials or redoing a calibration
+#define CFG_CRITICAL_FIELD(key, type, member, lo, hi, fallback) CFG_FIELD_DEF(key, type, member, lo, hi, fallback, CFG_FLAG_CRITICAL)
+#define CFG_WIFI_FIELDS(i) \
+  CFG_CRITICAL_FIELD("w" #i "ssid", CFG_STR, wifiNetworks[i].ssid, 0, 0, 0), \
+  CFG_FIELD_DEF("w" #i "pass", CFG_STR, wifiNetworks[i].password, 0, 0, 0, CFG_FLAG_CRITICAL | CFG_FLAG_SECRET), \
+  CFG_CRITICAL_FIELD("w" #i "en", CFG_BOOL, wifiNetworks[i].enabled, 0, 0, 1)
+
+const ConfigField CONFIG_FIELDS[] = {
+  CFG_FIELD("leftSp", CFG_FLOAT, leftSetpoint, -20, 10, 4.0),
+  CFG_FIELD("rightSp", CFG_FLOAT, rightSetpoint, -20, 10, 4.0),
+  CFG_FIELD("hyst", CFG_FLOAT, hysteresis, 1.0, 8.0, 1.5),
+  CFG_FIELD("minRun", CFG_FLOAT, minRunTime, 0.5, 10.0, 1.0),
+  CFG_FIELD("minStop", CFG_FLOAT, minStopTime, 1.0, 15.0, 5.0),
+  CFG_FIELD("minSwitch", CFG_FLOAT, minZoneSwitchTime, 1.0, 10.0, 5.0),
+  CFG_FIELD("maxRun", CFG_FLOAT, maxRunTime, 10.0, 45.0, 30.0),
+  CFG_FIELD("tempOffset", CFG_FLOAT, tempOffset, -5.0, 5.0, 0.0),
+  CFG_FIELD("leftEn", CFG_BOOL, leftEnabled, 0, 0, 1),
+  CFG_FIELD("rightEn", CFG_BOOL, rightEnabled, 0, 0, 1),
+  CFG_FIELD("autoUpd", CFG_BOOL, autoUpdatesEnabled, 0, 0, 1),
+  CFG_WIFI_FIELDS(0),
+  CFG_WIFI_FIELDS(1),
+  CFG_WIFI_FIELDS(2),
+  CFG_WIFI_FIELDS(3),
+  CFG_WIFI_FIELDS(4),
+  CFG_CRITICAL_FIELD("ntcCal", CFG_BOOL, ntcCalibrated, 0, 0, 0),
+  CFG_CRITICAL_FIELD("cal1Temp", CFG_FLOAT, calPoint1Temp, 0, 0, 25.0),
+  CFG_CRITICAL_FIELD("cal1ResL", CFG_FLOAT, calPoint1ResistanceLeft, 0, 0, 2500),
+  CFG_CRITICAL_FIELD("cal1ResR", CFG_FLOAT, calPoint1ResistanceRight, 0, 0, 2500),
+  CFG_CRITICAL_FIELD("cal2Temp", CFG_FLOAT, calPoint2Temp, 0, 0, 0.0),
+  CFG_CRITICAL_FIELD("cal2ResL", CFG_FLOAT, calPoint2ResistanceLeft, 0, 0, 0),
+  CFG_CRITICAL_FIELD("cal2ResR", CFG_FLOAT, calPoint2ResistanceRight, 0, 0, 0),
+  CFG_CRITICAL_FIELD("calBeta", CFG_FLOAT, customBCoefficient, 0, 0, 0),
+  CFG_CRITICAL_FIELD("calNomT", CFG_FLOAT, customNominalTemp, 0, 0, 0),
+  CFG_CRITICAL_FIELD("calNomR", CFG_FLOAT, customNominalResistance, 0, 0, 0),
+  CFG_FIELD("oldSsid", CFG_STR, old_ssid, 0, 0, 0),
+  CFG_FIELD_DEF("oldPass", CFG_STR, old_password, 0, 0, 0, CFG_FLAG_SECRET),
+  CFG_FIELD("filterMode", CFG_U8, filterMode, FILTER_NONE, FILTER_KALMAN, FILTER_EMA),
+  CFG_FIELD("filterTau", CFG_FLOAT, filterTimeConstant, 1.0, 600.0, 10.0),
+  CFG_FIELD("kalmanQ", CFG_FLOAT, kalmanProcessNoise, 1e-7, 1.0, 0.0001),
+  CFG_FIELD("kalmanR", CFG_FLOAT, kalmanMeasurementNoise, 1e-4, 10.0, 0.05),
+  CFG_FIELD("sampleMs", CFG_U32, sampleIntervalMs, 20, 5000, 100),
+  CFG_FIELD("controlMs", CFG_U32, controlIntervalMs, 100, 10000, 1000),
+  CFG_FIELD("logMs", CFG_U32, logIntervalMs, 1000, 600000, 2000),
+};
+const int CONFIG_FIELD_COUNT = sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]);
 
-void loadConfig() {
-  EEPROM.get(0, config);
+struct ConfigSlot {
+  Config values;               // What the slot holds in NVS, to find changed keys
+  uint32_t seq = 0;
+  bool valid = false;          // CRC verified or written by us
+};
+ConfigSlot configSlots[2];
+int activeConfigSlot = -1;     // Slot holding the newest commit
+
+// Non-critical changes are coalesced: flushed once edits go quiet, or after a maximum delay
+#define CONFIG_SAVE_DEBOUNCE_MS 3000
+#define CONFIG_SAVE_MAX_DELAY_MS 15000
+
+struct ConfigSaveState {
+  bool dirty = false;
+  unsigned long firstChange = 0;   // Oldest unsaved change
+  unsigned long lastChange = 0;
+  uint32_t coalesced = 0;          // Changes absorbed by the pending flush
+};
+ConfigSaveState configSave;
 
-  if (isnan(config.leftSetpoint) || config.leftSetpoint < -20 || config.leftSetpoint > 10) {
-    config.leftSetpoint = 4.0;
-    factoryDefaultsLoaded = true;
+uint8_t* configFieldPtr(Config& cfg, const ConfigField& field) {
+  return (uint8_t*)&cfg + field.offset;
+}
+
+// Bytes of a field that count for comparison and CRC (strings up to their terminator)
+size_t configFieldLength(Config& cfg, const ConfigField& field) {
+  if (field.type == CFG_STR) return strnlen((const char*)configFieldPtr(cfg, field), field.size);
+  return field.size;
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
   }
+  return ~crc;
+}
 
-  if (isnan(config.rightSetpoint) || config.rightSetpoint < -20 || config.rightSetpoint > 10) {
-    config.rightSetpoint = 4.0;
-    factoryDefaultsLoaded = true;
+uint32_t configCrc(Config& cfg) {
+  uint32_t crc = 0;
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    const ConfigField& field = CONFIG_FIELDS[i];
+    crc = crc32Update(crc, (const uint8_t*)field.key, strlen(field.key));
+    crc = crc32Update(crc, configFieldPtr(cfg, field), configFieldLength(cfg, field));
   }
+  return crc;
+}
 
-  if (isnan(config.hysteresis) || config.hysteresis < 1.0 || config.hysteresis > 8.0) {
-    config.hysteresis = 1.5;
-    factoryDefaultsLoaded = true;
+bool configFieldChanged(Config& a, Config& b, const ConfigField& field) {
+  size_t len = configFieldLength(a, field);
+  return len != configFieldLength(b, field) || memcmp(configFieldPtr(a, field), configFieldPtr(b, field), len) != 0;
+}
+
+// Reset one out-of-range or malformed field; returns true if it was changed
+bool sanitizeConfigField(Config& cfg, const ConfigField& field) {
+  uint8_t* p = configFieldPtr(cfg, field);
+  bool checked = field.minValue != field.maxValue;
+  switch (field.type) {
+    case CFG_FLOAT: {
+      float v;
+      memcpy(&v, p, sizeof(v));
+      if (isnan(v) || isinf(v) || (checked && (v < field.minValue || v > field.maxValue))) {
+        v = field.fallback;
+        memcpy(p, &v, sizeof(v));
+        return true;
+      }
+      return false;
+    }
+    case CFG_BOOL:
+      if (*p > 1) {
+        *p = field.fallback != 0;
+        return true;
+      }
+      return false;
+    case CFG_U8:
+      if (checked && (*p < field.minValue || *p > field.maxValue)) {
+        *p = (uint8_t)field.fallback;
+        return true;
+      }
+      return false;
+    case CFG_U32: {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      if (checked && (v < field.minValue || v > field.maxValue)) {
+        v = (uint32_t)field.fallback;
+        memcpy(p, &v, sizeof(v));
+        return true;
+      }
+      return false;
+    }
+    case CFG_STR: {
+      // Erased flash reads as 0xFF; anything unterminated is cut at the buffer end
+      bool changed = p[0] == 0xFF || p[field.size - 1] != 0;
+      if (p[0] == 0xFF) p[0] = '\0';
+      p[field.size - 1] = '\0';
+      return changed;
+    }
   }
+  return false;
+}
 
-  if (isnan(config.minRunTime) || config.minRunTime < 0.5 || config.minRunTime > 10.0) {
-    config.minRunTime = 1.0;
-    factoryDefaultsLoaded = true;
+void readConfigField(Preferences& prefs, Config& cfg, const ConfigField& field) {
+  if (!prefs.isKey(field.key)) return;  // Added in a later schema - keep the default
+  uint8_t* p = configFieldPtr(cfg, field);
+  switch (field.type) {
+    case CFG_FLOAT: { float v = prefs.getFloat(field.key); memcpy(p, &v, sizeof(v)); break; }
+    case CFG_BOOL: *p = prefs.getBool(field.key); break;
+    case CFG_U8: *p = prefs.getUChar(field.key); break;
+    case CFG_U32: { uint32_t v = prefs.getUInt(field.key); memcpy(p, &v, sizeof(v)); break; }
+    case CFG_STR: prefs.getString(field.key, (char*)p, field.size); break;
   }
+}
 
-  if (isnan(config.minStopTime) || config.minStopTime < 1.0 || config.minStopTime > 15.0) {
-    config.minStopTime = 5.0;
-    factoryDefaultsLoaded = true;
+bool writeConfigField(Preferences& prefs, Config& cfg, const ConfigField& field) {
+  uint8_t* p = configFieldPtr(cfg, field);
+  switch (field.type) {
+    case CFG_FLOAT: { float v; memcpy(&v, p, sizeof(v)); return prefs.putFloat(field.key, v) > 0; }
+    case CFG_BOOL: return prefs.putBool(field.key, *p) > 0;
+    case CFG_U8: return prefs.putUChar(field.key, *p) > 0;
+    case CFG_U32: { uint32_t v; memcpy(&v, p, sizeof(v)); return prefs.putUInt(field.key, v) > 0; }
+    case CFG_STR: prefs.putString(field.key, (const char*)p); return true;  // Empty strings report 0 bytes
   }
+  return false;
+}
 
-  if (isnan(config.minZoneSwitchTime) || config.minZoneSwitchTime < 1.0 || config.minZoneSwitchTime > 10.0) {
-    config.minZoneSwitchTime = 5.0;
-    factoryDefaultsLoaded = true;
+// Schema migration hook: bring values read under an older schema up to date
+void migrateConfig(uint16_t fromSchema) {
+  LOGI(LOG_CFG, "Migrating config from schema %u to %u", fromSchema, CONFIG_SCHEMA_VERSION);
+  // Schema 0 is the EEPROM image, already read into config by loadConfig(); its fields map
+  // one to one onto the NVS keys. Schema 1 was a single store without a sequence number and
+  // needs no conversion. Later schemas add their conversions here.
+}
+
+// Slot CRC: all field values, then the sequence number (schema 1 stores had none)
+uint32_t configSlotCrc(Config& cfg, uint16_t schema, uint32_t seq) {
+  uint32_t crc = configCrc(cfg);
+  if (schema >= 2) crc = crc32Update(crc, (const uint8_t*)&seq, sizeof(seq));
+  return crc;
+}
+
+// Read one slot into configSlots[slot] on top of the current defaults
+bool readConfigSlot(int slot, uint16_t& schema) {
+  ConfigSlot& s = configSlots[slot];
+  s.valid = false;
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_SLOT_NAMESPACES[slot], true) || !prefs.isKey("schema")) {
+    prefs.end();
+    return false;
   }
+  schema = prefs.getUShort("schema", 0);
+  s.seq = prefs.getUInt("seq", 0);
+  s.values = config;
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) readConfigField(prefs, s.values, CONFIG_FIELDS[i]);
+  uint32_t storedCrc = prefs.getUInt("crc", 0);
+  prefs.end();
+  s.valid = storedCrc == configSlotCrc(s.values, schema, s.seq);
+  return true;
+}
 
-  if (isnan(config.maxRunTime) || config.maxRunTime < 10.0 || config.maxRunTime > 45.0) {
-    config.maxRunTime = 30.0;
-    factoryDefaultsLoaded = true;
+// Commit config to the inactive slot: changed keys, then the sequence number, then the CRC.
+// Until the CRC lands the slot fails validation, so a brown-out mid-commit leaves the active
+// slot as the newest valid one.
+bool writeConfigStore(bool all) {
+  int target = activeConfigSlot < 0 ? 0 : 1 - activeConfigSlot;
+  ConfigSlot& slot = configSlots[target];
+  bool full = all || !slot.valid;
+
+  if (!all && activeConfigSlot >= 0) {
+    bool changed = false;
+    for (int i = 0; i < CONFIG_FIELD_COUNT && !changed; i++) {
+      changed = configFieldChanged(config, configSlots[activeConfigSlot].values, CONFIG_FIELDS[i]);
+    }
+    if (!changed) {
+      configSave.dirty = false;
+      configSave.coalesced = 0;
+      return true;
+    }
   }
 
-  if (isnan(config.tempOffset) || config.tempOffset < -5.0 || config.tempOffset > 5.0) {
-    config.tempOffset = 0.0;
-    factoryDefaultsLoaded = true;
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_SLOT_NAMESPACES[target], false)) {
+    LOGE(LOG_CFG, "Cannot open config slot %d", target);
+    return false;
   }
 
-  if (config.leftEnabled != true && config.leftEnabled != false) {
-    config.leftEnabled = true;
-    factoryDefaultsLoaded = true;
+  unsigned long start = millis();
+  uint32_t seq = configSeq + 1;
+  int written = 0;
+  bool ok = true;
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    const ConfigField& field = CONFIG_FIELDS[i];
+    if (!full && !configFieldChanged(config, slot.values, field)) continue;
+    ok = writeConfigField(prefs, config, field) && ok;
+    written++;
+  }
+  ok = prefs.putUShort("schema", CONFIG_SCHEMA_VERSION) > 0 && ok;
+  ok = prefs.putUInt("seq", seq) > 0 && ok;
+  if (ok) ok = prefs.putUInt("crc", configSlotCrc(config, CONFIG_SCHEMA_VERSION, seq)) > 0;
+  prefs.end();
+
+  slot.values = config;
+  slot.seq = seq;
+  slot.valid = ok;
+  if (ok) {
+    activeConfigSlot = target;
+    configSeq = seq;
+    configSave.dirty = false;
+  } else {
+    LOGE(LOG_CFG, "Config commit to slot %d failed - slot %d still active", target, activeConfigSlot);
+  }
+  LOGD(LOG_CFG, "Config seq %lu saved to slot %d: %d keys in %lu ms (%u changes coalesced)",
+    (unsigned long)seq, target, written, millis() - start, (unsigned)configSave.coalesced);
+  configSave.coalesced = 0;
+  return ok;
+}
+
+// Write pending changes now; used for critical fields and before a restart
+void saveConfig() {
+  writeConfigStore(false);
+}
+
+// Record a config change. Critical fields are written straight away, everything else is
+// left for serviceConfigStore() so a burst of edits costs one flash write.
+void markConfigDirty() {
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    const ConfigField& field = CONFIG_FIELDS[i];
+    if ((field.flags & CFG_FLAG_CRITICAL) && (activeConfigSlot < 0 ||
+        configFieldChanged(config, configSlots[activeConfigSlot].values, field))) {
+      if (writeConfigStore(false)) return;
+      // Don't leave the change only in RAM: serviceConfigStore() retries it
+      break;
+    }
   }
 
-  if (config.rightEnabled != true && config.rightEnabled != false) {
-    config.rightEnabled = true;
-    factoryDefaultsLoaded = true;
+  unsigned long now = millis();
+  if (!configSave.dirty) {
+    configSave.dirty = true;
+    configSave.firstChange = now;
   }
+  configSave.lastChange = now;
+  configSave.coalesced++;
+}
 
-  // Initialize calibration defaults if not properly set
-  if (config.calPoint1ResistanceLeft <= 0 || isnan(config.calPoint1ResistanceLeft)) {
-    config.calPoint1ResistanceLeft = 2500;
-    config.calPoint1ResistanceRight = 2500;
-    config.calPoint1Temp = 25.0;
+void serviceConfigStore() {
+  if (!configSave.dirty) return;
+  unsigned long now = millis();
+  if (now - configSave.lastChange >= CONFIG_SAVE_DEBOUNCE_MS ||
+      now - configSave.firstChange >= CONFIG_SAVE_MAX_DELAY_MS) {
+    if (!writeConfigStore(false)) configSave.firstChange = now;  // Retry after another max delay
   }
+}
 
-  if (config.calPoint2ResistanceLeft >= 0 && isnan(config.calPoint2ResistanceLeft)) {
-    config.calPoint2ResistanceLeft = 0;
-    config.calPoint2ResistanceRight = 0;
-    config.calPoint2Temp = 0.0;
+// Range-check every field against CONFIG_FIELDS and apply the calibration group rules.
+// Returns true if any field had to be reset.
+bool sanitizeConfig(Config& cfg) {
+  bool changed = false;
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    if (sanitizeConfigField(cfg, CONFIG_FIELDS[i])) changed = true;
   }
 
-  if (isnan(config.customBCoefficient) || config.customBCoefficient <= 0) {
-    config.customBCoefficient = 0;
-    config.customNominalTemp = 0;
-    config.customNominalResistance = 0;
-    config.ntcCalibrated = false;
+  // Calibration fields are only meaningful as groups
+  if (cfg.calPoint1ResistanceLeft <= 0) {
+    cfg.calPoint1ResistanceLeft = 2500;
+    cfg.calPoint1ResistanceRight = 2500;
+    cfg.calPoint1Temp = 25.0;
+    changed = true;
   }
 
-  if (factoryDefaultsLoaded) {
-    saveConfig();  // commit restored defaults to EEPROM
-    Serial.println("⚠️ Factory defaults loaded due to invalid or missing config.");
+  if (cfg.customBCoefficient <= 0) {
+    if (cfg.customBCoefficient != 0 || cfg.customNominalTemp != 0 || cfg.customNominalResistance != 0 ||
+        cfg.ntcCalibrated) changed = true;
+    cfg.customBCoefficient = 0;
+    cfg.customNominalTemp = 0;
+    cfg.customNominalResistance = 0;
+    cfg.ntcCalibrated = false;
   }
+  return changed;
 }
 
-String getLogsJSON() {
-  DynamicJsonDocument doc(4096); // Larger buffer for log data
+bool factoryDefaultsLoaded = false;
 
-  // Create root array
-  JsonArray logs = doc.to<JsonArray>();
+void loadConfig() {
+  uint16_t schema[2] = {0, 0};
+  bool present[2];
+  for (int i = 0; i < 2; i++) present[i] = readConfigSlot(i, schema[i]);
+
+  // Newest valid slot wins; sequence numbers compare modulo 2^32
+  int chosen = -1;
+  for (int i = 0; i < 2; i++) {
+    if (!configSlots[i].valid) continue;
+    if (chosen < 0 || (int32_t)(configSlots[i].seq - configSlots[chosen].seq) > 0) chosen = i;
+  }
 
-  // Return all available log entries (may be less than MAX_LOG_ENTRIES)
-  for (int i = 0; i < logCount; i++) {
-    JsonObject entry = logs.createNestedObject();
-    entry["timestamp"] = tempLog[i].timestamp;
-    entry["leftTemp"] = tempLog[i].leftTemp;
-    entry["rightTemp"] = tempLog[i].rightTemp;
-    entry["setpointLeft"] = tempLog[i].setpointLeft;
-    entry["setpointRight"] = tempLog[i].setpointRight;
+  bool rewriteAll = false;
+  if (chosen >= 0) {
+    config = configSlots[chosen].values;
+    activeConfigSlot = chosen;
+    configSeq = configSlots[chosen].seq;
+    if (schema[chosen] < CONFIG_SCHEMA_VERSION) {
+      migrateConfig(schema[chosen]);
+      rewriteAll = true;
+    }
+  } else if (present[0] || present[1]) {
+    // Both slots corrupted: keep what passes validation in the newer one, reset the rest
+    int newest = !present[1] || (present[0] && (int32_t)(configSlots[0].seq - configSlots[1].seq) > 0) ? 0 : 1;
+    LOGE(LOG_CFG, "No valid config slot - validating fields of slot %d individually", newest);
+    config = configSlots[newest].values;
+    configSeq = configSlots[newest].seq;
+    factoryDefaultsLoaded = true;
+    rewriteAll = true;
+  } else {
+    // No NVS store yet: migrate the legacy EEPROM struct image
+    EEPROM.get(0, config);
+    migrateConfig(0);
+    rewriteAll = true;
+  }
+
+  // A verified slot still gets the range checks: values saved by older firmware (or a future
+  // bug) must not stick forever. Only changed fields are written back.
+  if (sanitizeConfig(config)) factoryDefaultsLoaded = true;
+
+  writeConfigStore(rewriteAll);  // commit migrated or restored values to NVS
+  if (factoryDefaultsLoaded) {
+    LOGW(LOG_CFG, "Factory defaults loaded for invalid or missing config fields.");
+  }
+}
+
+// ---- Config snapshots ----
+// A snapshot lists every CONFIG_FIELDS entry under its NVS key, so export and import cover
+// new fields without further changes here. Secrets (WiFi passwords) are only exported on request.
+void sendConfigSnapshot(bool includeSecrets) {
+  DynamicJsonDocument doc(4096);
+  doc["schema"] = CONFIG_SCHEMA_VERSION;
+  doc["firmware"] = CURRENT_VERSION;
+  doc["seq"] = configSeq;
+  doc["secrets"] = includeSecrets;
+  JsonObject values = doc.createNestedObject("config");
+  for (int i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    const ConfigField& field = CONFIG_FIELDS[i];
+    if ((field.flags & CFG_FLAG_SECRET) && !includeSecrets) continue;
+    uint8_t* p = configFieldPtr(config, field);
+    switch (field.type) {
+      case CFG_FLOAT: { float v; memcpy(&v, p, sizeof(v)); values[field.key] = v; break; }
+      case CFG_BOOL: values[field.key] = *p != 0; break;
+      case CFG_U8: values[field.key] = *p; break;
+      case CFG_U32: { uint32_t v; memcpy(&v, p, sizeof(v)); values[field.key] = v; break; }
+      case CFG_STR: values[field.key] = (const char*)p; break;
+    }
   }
 
   String output;
   serializeJson(doc, output);
-  return output;
+  server.sendHeader("Content-Disposition", "attachment; filename=\"fridge-config.json\"");
+  server.send(200, "application/json", output);
+}
+
+// Parse one snapshot value into cfg; false if it has the wrong type or is out of range
+bool importConfigValue(Config& cfg, const ConfigField& field, JsonVariant value) {
+  uint8_t* p = configFieldPtr(cfg, field);
+  bool checked = field.minValue != field.maxValue;
+  switch (field.type) {
+    case CFG_FLOAT: {
+      if (!value.is<float>()) return false;
+      float v = value.as<float>();
+      if (isnan(v) || isinf(v) || (checked && (v < field.minValue || v > field.maxValue))) return false;
+      memcpy(p, &v, sizeof(v));
+      return true;
+    }
+    case CFG_BOOL:
+      if (!value.is<bool>()) return false;
+      *p = value.as<bool>();
+      return true;
+    case CFG_U8:
+    case CFG_U32: {
+      if (!value.is<uint32_t>()) return false;
+      uint32_t v = value.as<uint32_t>();
+      if ((field.type == CFG_U8 && v > 255) || (checked && (v < field.minValue || v > field.maxValue))) return false;
+      if (field.type == CFG_U8) *p = (uint8_t)v;
+      else memcpy(p, &v, sizeof(v));
+      return true;
+    }
+    case CFG_STR: {
+      if (!value.is<const char*>()) return false;
+      const char* v = value.as<const char*>();
+      if (strlen(v) >= field.size) return false;
+      memset(p, 0, field.size);
+      strcpy((char*)p, v);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Validate a whole snapshot before touching config, then apply it as one slot commit.
+// Fields missing from the snapshot (e.g. secrets left out of the export) keep their values.
+bool importConfigSnapshot(JsonObject snapshot, String& error, int& applied) {
+  uint16_t schema = snapshot["schema"] | 0;
+  if (schema < 1 || schema > CONFIG_SCHEMA_VERSION) {
+    error = "unsupported schema " + String(schema);
+    return false;
+  }
+  JsonObject values = snapshot["config"];
+  if (values.isNull()) {
+    error = "missing config object";
+    return false;
+  }
+
+  Config candidate = config;
+  applied = 0;
+  for (JsonPair kv : values) {
+    const char* key = kv.key().c_str();
+    int index = -1;
+    for (int i = 0; i < CONFIG_FIELD_COUNT && index < 0; i++) {
+      if (strcmp(CONFIG_FIELDS[i].key, key) == 0) index = i;
+    }
+    if (index < 0) {
+      error = "unknown key " + String(key);
+      return false;
+    }
+    if (!importConfigValue(candidate, CONFIG_FIELDS[index], kv.value())) {
+      error = "invalid value for " + String(key);
+      return false;
+    }
+    applied++;
+  }
+
+  // Same group rules as a stored config (e.g. calibrated without a B coefficient)
+  if (sanitizeConfig(candidate)) {
+    LOGW(LOG_CFG, "Imported config had inconsistent calibration fields - reset to defaults");
+  }
+
+  // All or nothing: the running config only changes if the snapshot is committed
+  Config previous = config;
+  config = candidate;
+  if (!writeConfigStore(false)) {
+    config = previous;
+    error = "config commit failed";
+    return false;
+  }
+  if (candidate.filterMode != previous.filterMode) {
+    leftFilter.initialized = false;  // Restart both filters from the next reading
+    rightFilter.initialized = false;
+  }
+  return true;
+}
+
+// Stream log entries with fromTs <= timestamp <= toTs, oldest first. The range is found by
+// binary search, so only the matching entries are decoded. With a limit, the newest
+// `limit` entries of the range are returned.
+void sendLogsJSON(uint32_t fromTs, uint32_t toTs, int limit) {
+  int first = logLowerBound(fromTs);
+  int last = logUpperBound(toTs);
+  if (limit > 0 && last - first > limit) first = last - limit;
+
+  ChunkedWriter out;
+  out.begin("application/json");
+  out.print("[");
+
+  char l[12], r[12], lr[12], rr[12], faults[40];
+  for (int i = first; i < last; i++) {
+    TemperatureLogEntry e = readLogEntry(logStorageIndex(i));
+    // Faulted zones are logged as null so charts show a gap instead of garbage
+    writeJsonTemp(l, sizeof(l), e.leftTemp);
+    writeJsonTemp(r, sizeof(r), e.rightTemp);
+    writeJsonTemp(lr, sizeof(lr), e.leftRaw);
+    writeJsonTemp(rr, sizeof(rr), e.rightRaw);
+    formatLogFlags(faults, sizeof(faults), e.faults);
+    out.printf("%s{\"timestamp\":%lu,\"leftTemp\":%s,\"rightTemp\":%s,\"setpointLeft\":%.2f,\"setpointRight\":%.2f,"
+               "\"leftRaw\":%s,\"rightRaw\":%s%s}",
+      i > first ? "," : "", (unsigned long)e.timestamp, l, r, e.setpointLeft, e.setpointRight, lr, rr, faults);
+  }
+
+  out.print("]");
+  out.end();
 }
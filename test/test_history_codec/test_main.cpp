@@ -0,0 +1,203 @@
+// Host tests for the history block codec: pio test -e native
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "history_codec.h"
+
+#define BLOCK_ENTRIES 30           // HIST_STAGE_ENTRIES in main.cpp: one block per flush
+#define FUZZ_ROUNDS 20000
+#define BENCH_BLOCKS 20000
+
+static uint32_t seed = 0x2545F491;
+
+static uint32_t rnd(uint32_t n) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed % n;
+}
+
+static int16_t clampTemp(int32_t v) {
+  return v < -32767 ? -32767 : v > 32767 ? 32767 : v;
+}
+
+// Random block shaped like real data: 2 s steps with occasional clock jumps, slow
+// random walks with the odd step change, missing values and fault changes
+static int randomBlock(HistorySample* samples) {
+  int count = 1 + rnd(BLOCK_ENTRIES);
+  uint32_t ts = 1700000000UL + rnd(100000000UL);
+  int32_t left = -1000 + rnd(3000), right = -1000 + rnd(3000);
+  uint8_t faults = 0;
+  for (int i = 0; i < count; i++) {
+    ts += rnd(20) == 0 ? rnd(200000) : 2;
+    left += rnd(20) == 0 ? (int32_t)rnd(2001) - 1000 : (int32_t)rnd(21) - 10;
+    right += (int32_t)rnd(21) - 10;
+    if (rnd(15) == 0) faults = rnd(256);
+    HistorySample& s = samples[i];
+    s.timestamp = ts;
+    s.faults = faults;
+    s.leftTemp = rnd(25) ? clampTemp(left) : INT16_MIN;       // LOG_NO_VALUE
+    s.rightTemp = rnd(30) ? clampTemp(right) : INT16_MIN;
+    s.leftRawDelta = rnd(10) ? (int8_t)((int)rnd(256) - 128) : INT8_MIN;
+    s.rightRawDelta = (int8_t)((int)rnd(9) - 4);
+  }
+  return count;
+}
+
+static bool sameSample(const HistorySample& a, const HistorySample& b) {
+  return a.timestamp == b.timestamp && a.faults == b.faults && a.leftTemp == b.leftTemp &&
+         a.rightTemp == b.rightTemp && a.leftRawDelta == b.leftRawDelta && a.rightRawDelta == b.rightRawDelta;
+}
+
+static bool roundTrips(const HistorySample* samples, int count) {
+  uint8_t buffer[BLOCK_ENTRIES * HIST_MAX_ENCODED_ENTRY];
+  size_t len = encodeHistoryBlock(samples, count, buffer);
+  if (len > (size_t)count * HIST_MAX_ENCODED_ENTRY) return false;
+
+  int index = 0;
+  bool match = true;
+  bool ok = decodeHistoryBlock(buffer, len, samples[0].timestamp, count, [&](const HistorySample& s) {
+    match = match && index < count && sameSample(s, samples[index]);
+    index++;
+    return true;
+  });
+  return ok && match && index == count;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_zigzag_varint_edges() {
+  const int32_t values[] = {0, 1, -1, 63, -64, 64, -65, 8191, -8192, INT16_MAX, INT16_MIN, INT32_MAX, INT32_MIN};
+  for (int32_t v : values) {
+    uint8_t buffer[8];
+    size_t pos = 0;
+    putVarint(buffer, pos, zigzag(v));
+    TEST_ASSERT_TRUE(pos <= 5);
+
+    size_t readPos = 0;
+    uint32_t decoded;
+    TEST_ASSERT_TRUE(getVarint(buffer, pos, readPos, decoded));
+    TEST_ASSERT_EQUAL_UINT32(pos, readPos);
+    TEST_ASSERT_EQUAL_INT32(v, unzigzag(decoded));
+
+    // One byte short must fail rather than read past the end
+    readPos = 0;
+    TEST_ASSERT_FALSE(getVarint(buffer, pos - 1, readPos, decoded));
+  }
+}
+
+void test_random_blocks_round_trip() {
+  HistorySample samples[BLOCK_ENTRIES];
+  for (int round = 0; round < FUZZ_ROUNDS; round++) {
+    int count = randomBlock(samples);
+    if (!roundTrips(samples, count)) {
+      char message[64];
+      snprintf(message, sizeof(message), "round %d failed to round-trip", round);
+      TEST_FAIL_MESSAGE(message);
+    }
+  }
+}
+
+// Full-range swings every entry force every wide form to its longest encoding
+void test_worst_case_fits_max_entry_size() {
+  HistorySample samples[BLOCK_ENTRIES];
+  for (int i = 0; i < BLOCK_ENTRIES; i++) {
+    bool odd = i & 1;
+    samples[i] = {odd ? 0xFFFFFFFFu : 0u, (uint8_t)(odd ? 0xFF : 0x00),
+                  (int16_t)(odd ? INT16_MIN : INT16_MAX), (int16_t)(odd ? INT16_MAX : INT16_MIN),
+                  (int8_t)(odd ? INT8_MIN : INT8_MAX), (int8_t)(odd ? INT8_MAX : INT8_MIN)};
+  }
+  TEST_ASSERT_TRUE(roundTrips(samples, BLOCK_ENTRIES));
+}
+
+void test_steady_data_compresses() {
+  HistorySample samples[BLOCK_ENTRIES];
+  for (int i = 0; i < BLOCK_ENTRIES; i++) {
+    samples[i] = {(uint32_t)(1700000000UL + i * 2), 0, (int16_t)(400 + (i & 1)), 350, 0, 0};
+  }
+  uint8_t buffer[BLOCK_ENTRIES * HIST_MAX_ENCODED_ENTRY];
+  // The first entry carries the absolute temperatures (two 2-byte varints) and the second
+  // the 2 s step; after that each entry is a tag plus two nibble pairs
+  TEST_ASSERT_EQUAL_UINT32(6 + 4 + (BLOCK_ENTRIES - 2) * 3, encodeHistoryBlock(samples, BLOCK_ENTRIES, buffer));
+}
+
+void test_malformed_blocks_rejected() {
+  HistorySample samples[BLOCK_ENTRIES];
+  uint8_t buffer[BLOCK_ENTRIES * HIST_MAX_ENCODED_ENTRY];
+  auto any = [](const HistorySample&) { return true; };
+  for (int round = 0; round < 1000; round++) {
+    int count = randomBlock(samples);
+    size_t len = encodeHistoryBlock(samples, count, buffer);
+    uint32_t first = samples[0].timestamp;
+
+    TEST_ASSERT_TRUE(decodeHistoryBlock(buffer, len, first, count, any));
+    TEST_ASSERT_FALSE(decodeHistoryBlock(buffer, len - 1 - rnd(len), first, count, any));  // Torn block
+    TEST_ASSERT_FALSE(decodeHistoryBlock(buffer, len, first, count + 1, any));              // Count too high
+    if (count > 1) TEST_ASSERT_FALSE(decodeHistoryBlock(buffer, len, first, count - 1, any));  // Trailing bytes
+  }
+}
+
+void test_callback_stops_decode() {
+  HistorySample samples[BLOCK_ENTRIES];
+  uint8_t buffer[BLOCK_ENTRIES * HIST_MAX_ENCODED_ENTRY];
+  for (int i = 0; i < BLOCK_ENTRIES; i++) samples[i] = {(uint32_t)(1000 + i * 2), 0, 0, 0, 0, 0};
+  size_t len = encodeHistoryBlock(samples, BLOCK_ENTRIES, buffer);
+
+  int seen = 0;
+  TEST_ASSERT_FALSE(decodeHistoryBlock(buffer, len, 1000, BLOCK_ENTRIES, [&](const HistorySample&) {
+    return ++seen < 5;
+  }));
+  TEST_ASSERT_EQUAL_INT(5, seen);
+}
+
+// Not a pass/fail check: reports decode throughput for comparison between changes
+void test_decode_throughput() {
+  static HistorySample samples[BENCH_BLOCKS / 100][BLOCK_ENTRIES];
+  static uint8_t buffers[BENCH_BLOCKS / 100][BLOCK_ENTRIES * HIST_MAX_ENCODED_ENTRY];
+  size_t lengths[BENCH_BLOCKS / 100];
+  size_t encodedBytes = 0;
+  for (int b = 0; b < BENCH_BLOCKS / 100; b++) {
+    uint32_t ts = 1700000000UL + b * 60;
+    for (int i = 0; i < BLOCK_ENTRIES; i++) {
+      ts += 2;
+      samples[b][i] = {ts, 0, (int16_t)(400 + (int)rnd(5) - 2), (int16_t)(350 + (int)rnd(5) - 2),
+                       (int8_t)((int)rnd(5) - 2), (int8_t)((int)rnd(5) - 2)};
+    }
+    lengths[b] = encodeHistoryBlock(samples[b], BLOCK_ENTRIES, buffers[b]);
+    encodedBytes += lengths[b];
+  }
+
+  uint64_t checksum = 0, decoded = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < 100; pass++) {
+    for (int b = 0; b < BENCH_BLOCKS / 100; b++) {
+      decodeHistoryBlock(buffers[b], lengths[b], samples[b][0].timestamp, BLOCK_ENTRIES, [&](const HistorySample& s) {
+        checksum += s.timestamp + s.leftTemp;
+        decoded++;
+        return true;
+      });
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  char message[128];
+  snprintf(message, sizeof(message), "decode %.1f M entries/s, %.2f bytes/entry (checksum %llu)",
+           seconds > 0 ? decoded / seconds / 1e6 : 0.0, (double)encodedBytes / (BENCH_BLOCKS / 100 * BLOCK_ENTRIES),
+           (unsigned long long)checksum);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT64((uint64_t)BENCH_BLOCKS * BLOCK_ENTRIES, decoded);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_zigzag_varint_edges);
+  RUN_TEST(test_random_blocks_round_trip);
+  RUN_TEST(test_worst_case_fits_max_entry_size);
+  RUN_TEST(test_steady_data_compresses);
+  RUN_TEST(test_malformed_blocks_rejected);
+  RUN_TEST(test_callback_stops_decode);
+  RUN_TEST(test_decode_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,93 @@
+// Minimal stand-in for the Arduino FS/File API, backed by real files under a temp directory.
+// Covers what history_format.h uses, plus a write budget to simulate a power cut mid-write.
+#ifndef MOCK_FS_H
+#define MOCK_FS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+
+class MockFile {
+ public:
+  MockFile() {}
+  MockFile(FILE* f, long* budget) : file_(f, fclose), budget_(budget) {}
+
+  explicit operator bool() const { return (bool)file_; }
+
+  size_t write(const uint8_t* data, size_t len) {
+    if (!file_) return 0;
+    size_t allowed = len;
+    if (*budget_ >= 0 && (long)allowed > *budget_) allowed = *budget_;
+    if (*budget_ >= 0) *budget_ -= allowed;
+    size_t written = fwrite(data, 1, allowed, file_.get());
+    fflush(file_.get());
+    return written;
+  }
+
+  size_t read(uint8_t* data, size_t len) {
+    return file_ ? fread(data, 1, len, file_.get()) : 0;
+  }
+
+  size_t position() const {
+    return file_ ? ftell(file_.get()) : 0;
+  }
+
+  size_t size() const {
+    if (!file_) return 0;
+    long current = ftell(file_.get());
+    fseek(file_.get(), 0, SEEK_END);
+    long end = ftell(file_.get());
+    fseek(file_.get(), current, SEEK_SET);
+    return end;
+  }
+
+  bool seek(uint32_t pos) {
+    return file_ && fseek(file_.get(), pos, SEEK_SET) == 0;
+  }
+
+  void close() { file_.reset(); }
+
+ private:
+  std::shared_ptr<FILE> file_;
+  long* budget_ = nullptr;
+};
+
+class MockFS {
+ public:
+  MockFS() {
+    char pattern[] = "/tmp/histfsXXXXXX";
+    root_ = mkdtemp(pattern);
+  }
+
+  ~MockFS() {
+    std::string command = "rm -rf '" + root_ + "'";
+    if (system(command.c_str()) != 0) fprintf(stderr, "could not remove %s\n", root_.c_str());
+  }
+
+  // Bytes that may still be written before writes come up short; negative is unlimited
+  void setWriteBudget(long bytes) { budget_ = bytes; }
+
+  bool mkdir(const char* path) { return ::mkdir(real(path).c_str(), 0755) == 0; }
+  bool exists(const char* path) { return access(real(path).c_str(), F_OK) == 0; }
+  bool remove(const char* path) { return ::remove(real(path).c_str()) == 0; }
+  bool rename(const char* from, const char* to) { return ::rename(real(from).c_str(), real(to).c_str()) == 0; }
+
+  MockFile open(const char* path, const char* mode) {
+    const char* stdioMode = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "rb";
+    FILE* f = fopen(real(path).c_str(), stdioMode);
+    return f ? MockFile(f, &budget_) : MockFile();
+  }
+
+ private:
+  std::string real(const char* path) const { return root_ + path; }
+
+  std::string root_;
+  long budget_ = -1;
+};
+
+#endif // MOCK_FS_H
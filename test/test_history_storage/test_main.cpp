@@ -0,0 +1,209 @@
+// Host tests for the history segment and index layout: pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "history_format.h"
+#include "mock_fs.h"
+
+#define SEGMENT_PATH "/hist/s00000007.bin"
+
+static MockFS* fs;
+static uint8_t buffer[HIST_BLOCK_MAX_BYTES];
+
+// count entries at 2 s steps starting at ts, values varying with the index
+static void fillSamples(HistorySample* samples, int count, uint32_t ts) {
+  for (int i = 0; i < count; i++) {
+    samples[i] = {ts + i * 2, (uint8_t)(i % 7 == 0), (int16_t)(400 + i * 3 - (int)(ts % 50)),
+                  (int16_t)(-1800 + i), (int8_t)(i % 5 - 2), (int8_t)(i % 3)};
+  }
+}
+
+// Segment with blocks of the given sizes, each continuing 2 s after the previous one
+static void writeSegment(const int* blockSizes, int blocks, HistorySample* all) {
+  MockFile file = fs->open(SEGMENT_PATH, "w");
+  TEST_ASSERT_TRUE(writeSegmentHeader(file, 7, 1700000000));
+  file.close();
+
+  int total = 0;
+  for (int b = 0; b < blocks; b++) {
+    fillSamples(&all[total], blockSizes[b], 1700000000 + total * 2);
+    MockFile append = fs->open(SEGMENT_PATH, "a");
+    HistoryBlockHeader block;
+    TEST_ASSERT_TRUE(appendHistoryBlock(append, &all[total], blockSizes[b], buffer, block));
+    append.close();
+    total += blockSizes[b];
+  }
+}
+
+void setUp() {
+  fs = new MockFS();
+  fs->mkdir("/hist");
+}
+
+void tearDown() {
+  delete fs;
+}
+
+// The structs are written to flash as-is, so their layout is the file format
+void test_layout_sizes() {
+  TEST_ASSERT_EQUAL_INT(16, sizeof(HistorySegmentHeader));
+  TEST_ASSERT_EQUAL_INT(16, sizeof(HistoryBlockHeader));
+  TEST_ASSERT_EQUAL_INT(16, sizeof(HistoryIndexEntry));
+}
+
+void test_segment_round_trip() {
+  const int sizes[] = {30, 30, 1, 17, 30};
+  HistorySample written[108];
+  writeSegment(sizes, 5, written);
+
+  MockFile file = fs->open(SEGMENT_PATH, "r");
+  HistorySegmentHeader header;
+  TEST_ASSERT_TRUE(readSegmentHeader(file, header));
+  TEST_ASSERT_EQUAL_UINT32(7, header.segmentId);
+  TEST_ASSERT_EQUAL_UINT32(1700000000, header.createdAt);
+
+  HistoryIndexEntry entry = {7, 0, 0, 0};
+  TEST_ASSERT_TRUE(scanHistorySegment(file, entry));
+  TEST_ASSERT_EQUAL_UINT32(108, entry.count);
+  TEST_ASSERT_EQUAL_UINT32(written[0].timestamp, entry.firstTimestamp);
+  TEST_ASSERT_EQUAL_UINT32(written[107].timestamp, entry.lastTimestamp);
+
+  // Walk the blocks the way historyForEach does and compare every entry
+  file.seek(sizeof(HistorySegmentHeader));
+  HistoryBlockHeader block;
+  int index = 0;
+  while (file.position() < file.size()) {
+    TEST_ASSERT_TRUE(readBlockHeader(file, block));
+    TEST_ASSERT_EQUAL_UINT32(block.length, file.read(buffer, block.length));
+    TEST_ASSERT_TRUE(decodeHistoryBlock(buffer, block.length, block.firstTimestamp, block.count,
+                                        [&](const HistorySample& s) {
+      const HistorySample& e = written[index++];
+      return s.timestamp == e.timestamp && s.faults == e.faults && s.leftTemp == e.leftTemp &&
+             s.rightTemp == e.rightTemp && s.leftRawDelta == e.leftRawDelta && s.rightRawDelta == e.rightRawDelta;
+    }));
+  }
+  TEST_ASSERT_EQUAL_INT(108, index);
+}
+
+// A power cut part way through a block: the scan stops there and reports the tail as torn,
+// for a cut inside the block header as well as inside the encoded data
+void test_torn_block_ends_segment() {
+  const long cuts[] = {0, 5, sizeof(HistoryBlockHeader), sizeof(HistoryBlockHeader) + 10};
+  for (long cut : cuts) {
+    tearDown();
+    setUp();
+    const int sizes[] = {30, 30};
+    HistorySample written[90];
+    writeSegment(sizes, 2, written);
+
+    fillSamples(&written[60], 30, written[59].timestamp + 2);
+    fs->setWriteBudget(cut);
+    MockFile append = fs->open(SEGMENT_PATH, "a");
+    HistoryBlockHeader block;
+    TEST_ASSERT_FALSE(appendHistoryBlock(append, &written[60], 30, buffer, block));
+    append.close();
+    fs->setWriteBudget(-1);
+
+    MockFile file = fs->open(SEGMENT_PATH, "r");
+    HistorySegmentHeader header;
+    TEST_ASSERT_TRUE(readSegmentHeader(file, header));
+    HistoryIndexEntry entry = {7, 0, 0, 0};
+    // Nothing written at all leaves an intact segment
+    TEST_ASSERT_EQUAL(cut == 0, scanHistorySegment(file, entry));
+    TEST_ASSERT_EQUAL_UINT32(60, entry.count);
+    TEST_ASSERT_EQUAL_UINT32(written[59].timestamp, entry.lastTimestamp);
+  }
+}
+
+void test_block_header_checks() {
+  const int sizes[] = {10};
+  HistorySample written[10];
+  writeSegment(sizes, 1, written);
+  MockFile file = fs->open(SEGMENT_PATH, "r");
+  file.seek(sizeof(HistorySegmentHeader));
+  HistoryBlockHeader block;
+  TEST_ASSERT_TRUE(readBlockHeader(file, block));
+
+  // Corrupt magic, zero count and an oversized length are each rejected
+  HistoryBlockHeader bad[3] = {block, block, block};
+  bad[0].magic ^= 1;
+  bad[1].count = 0;
+  bad[2].length = HIST_BLOCK_MAX_BYTES + 1;
+  for (const HistoryBlockHeader& b : bad) {
+    MockFile out = fs->open("/hist/bad.bin", "w");
+    out.write((const uint8_t*)&b, sizeof(b));
+    out.write(buffer, HIST_BLOCK_MAX_BYTES + 1);
+    out.close();
+    MockFile in = fs->open("/hist/bad.bin", "r");
+    HistoryBlockHeader read;
+    TEST_ASSERT_FALSE(readBlockHeader(in, read));
+  }
+}
+
+// Segments from another format version or block header size are not read
+void test_incompatible_segment_header() {
+  HistorySegmentHeader headers[3];
+  for (HistorySegmentHeader& h : headers) h = {HIST_MAGIC, HIST_FORMAT_VERSION, sizeof(HistoryBlockHeader), 1, 0};
+  headers[0].magic = 0;
+  headers[1].version = HIST_FORMAT_VERSION - 1;
+  headers[2].blockHeaderSize = 12;
+  for (const HistorySegmentHeader& h : headers) {
+    MockFile out = fs->open(SEGMENT_PATH, "w");
+    out.write((const uint8_t*)&h, sizeof(h));
+    out.close();
+    MockFile in = fs->open(SEGMENT_PATH, "r");
+    HistorySegmentHeader read;
+    TEST_ASSERT_FALSE(readSegmentHeader(in, read));
+  }
+
+  MockFile empty = fs->open(SEGMENT_PATH, "w");
+  empty.close();
+  MockFile in = fs->open(SEGMENT_PATH, "r");
+  HistorySegmentHeader read;
+  TEST_ASSERT_FALSE(readSegmentHeader(in, read));
+}
+
+void test_index_round_trip() {
+  HistoryIndexEntry segments[5], read[8];
+  for (int i = 0; i < 5; i++) segments[i] = {(uint32_t)(10 + i), 1000u * i, 1000u * i + 998, 500};
+
+  TEST_ASSERT_EQUAL_INT(0, readHistoryIndex(*fs, read, 8));
+  TEST_ASSERT_TRUE(writeHistoryIndex(*fs, segments, 5));
+  TEST_ASSERT_FALSE(fs->exists(HIST_INDEX_TMP_PATH));
+  TEST_ASSERT_EQUAL_INT(5, readHistoryIndex(*fs, read, 8));
+  TEST_ASSERT_EQUAL_MEMORY(segments, read, sizeof(segments));
+
+  // Capped at the caller's capacity
+  TEST_ASSERT_EQUAL_INT(3, readHistoryIndex(*fs, read, 3));
+
+  // A trailing partial entry (an index from a cut-short copy) is ignored
+  MockFile append = fs->open(HIST_INDEX_PATH, "a");
+  append.write((const uint8_t*)&segments[0], 6);
+  append.close();
+  TEST_ASSERT_EQUAL_INT(5, readHistoryIndex(*fs, read, 8));
+}
+
+// A write that fails part way never replaces the previous index
+void test_failed_index_write_keeps_old_index() {
+  HistoryIndexEntry segments[4], read[4];
+  for (int i = 0; i < 4; i++) segments[i] = {(uint32_t)i, 0, 0, (uint32_t)i};
+  TEST_ASSERT_TRUE(writeHistoryIndex(*fs, segments, 2));
+
+  fs->setWriteBudget(sizeof(HistoryIndexEntry) * 3);
+  TEST_ASSERT_FALSE(writeHistoryIndex(*fs, segments, 4));
+  fs->setWriteBudget(-1);
+
+  TEST_ASSERT_EQUAL_INT(2, readHistoryIndex(*fs, read, 4));
+  TEST_ASSERT_EQUAL_MEMORY(segments, read, sizeof(HistoryIndexEntry) * 2);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_layout_sizes);
+  RUN_TEST(test_segment_round_trip);
+  RUN_TEST(test_torn_block_ends_segment);
+  RUN_TEST(test_block_header_checks);
+  RUN_TEST(test_incompatible_segment_header);
+  RUN_TEST(test_index_round_trip);
+  RUN_TEST(test_failed_index_write_keeps_old_index);
+  return UNITY_END();
+}